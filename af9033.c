@@ -25,6 +25,8 @@
 #include "dvb_frontend.h"
 #include <linux/slab.h>         /* for kzalloc/kfree */
 #include <linux/version.h>
+#include <linux/workqueue.h>
+#include <linux/delay.h>
 #include "af9033_priv.h"
 #include "af9033.h"
 #include "af9033_reg.h"
@@ -39,12 +41,37 @@
 #define V4L2_ONLY_DVB_V5
 #endif
 
-static int af9033_debug;
-module_param_named(debug, af9033_debug, int, 0644);
+DEFINE_DEBUG_PARAM(debug, af9033_debug);
 MODULE_PARM_DESC(debug, "Turn on/off frontend debugging (default:off).");
 static int af9033_snrdb;
 module_param_named(snrdb, af9033_snrdb, int, 0644);
 MODULE_PARM_DESC(snrdb, "Turn on/off SNR output as dBx10 (default:off).");
+static int af9033_fast_resume = 1;
+module_param_named(fast_resume, af9033_fast_resume, int, 0644);
+MODULE_PARM_DESC(fast_resume, "skip full init when registers were kept (default:on)");
+
+struct af9033_reg_val {
+	u8 mbox;
+	u16 reg;
+	u8 val;
+};
+
+struct af9033_reg_bits {
+	u8 mbox;
+	u16 reg;
+	u8 pos;
+	u8 len;
+	u8 val;
+};
+
+#define AF9033_REG_LIST_MAX 16
+
+/* power down polling of api_suspend_flag */
+#define AF9033_SLEEP_POLL_MAX_MS 16U
+#define AF9033_SLEEP_TIMEOUT_MS 1500
+
+/* written registers kept for bit writes */
+#define AF9033_SHADOW_SIZE 64
 
 struct af9033_state {
 	struct i2c_adapter *i2c;
@@ -57,19 +84,111 @@ struct af9033_state {
 	u16 snr;
 	u32 frequency;
 	unsigned long next_statistics_check;
+
+	struct af9033_reg_val shadow[AF9033_SHADOW_SIZE];
+	u8 shadow_cnt;
+	u8 shadow_next;
+
+	u8 init_done:1; /* full init was done, fast resume is possible */
+
+	s8 gate; /* tuner I2C bypass, -1 when not known */
+	u8 gate_hold; /* gate closed after set_frontend, not by tuner */
+
+	struct delayed_work sleep_work; /* finishes power down */
+	unsigned long sleep_timeout;
+	u8 sleep_polls;
 };
 
 static u8 regmask[8] = {0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff};
 
+/* registers changed by the hardware or the firmware, never shadowed */
+static const struct {
+	u8 mbox;
+	u16 first;
+	u16 last;
+} af9033_volatile_regs[] = {
+	{OFDM, 0x0000, 0x00ff}, /* OFSM firmware variables, api_* */
+	{OFDM, p_fd_tpsd_lock, p_fd_tpsd_lock},
+	{OFDM, r_mp2if_sync_byte_locked, r_mp2if_sync_byte_locked},
+};
+
+static bool af9033_reg_volatile(u8 mbox, u16 reg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(af9033_volatile_regs); i++) {
+		if (af9033_volatile_regs[i].mbox == mbox &&
+			reg >= af9033_volatile_regs[i].first &&
+			reg <= af9033_volatile_regs[i].last)
+			return true;
+	}
+	return false;
+}
+
+static struct af9033_reg_val *af9033_shadow_find(struct af9033_state *state,
+	u8 mbox, u16 reg)
+{
+	int i;
+
+	for (i = 0; i < state->shadow_cnt; i++) {
+		if (state->shadow[i].mbox == mbox &&
+			state->shadow[i].reg == reg)
+			return &state->shadow[i];
+	}
+	return NULL;
+}
+
+static bool af9033_shadow_get(struct af9033_state *state, u8 mbox, u16 reg,
+	u8 *val)
+{
+	struct af9033_reg_val *r = af9033_shadow_find(state, mbox, reg);
+
+	if (r)
+		*val = r->val;
+	return r != NULL;
+}
+
+/* update shadow after registers are written to the chip */
+static void af9033_shadow_set(struct af9033_state *state, u8 mbox, u16 reg,
+	const u8 *val, int len)
+{
+	struct af9033_reg_val *r;
+	int i;
+
+	for (i = 0; i < len; i++, reg++) {
+		if (af9033_reg_volatile(mbox, reg))
+			continue;
+
+		r = af9033_shadow_find(state, mbox, reg);
+		if (r == NULL) {
+			if (state->shadow_cnt < AF9033_SHADOW_SIZE) {
+				r = &state->shadow[state->shadow_cnt++];
+			} else {
+				r = &state->shadow[state->shadow_next++];
+				state->shadow_next %= AF9033_SHADOW_SIZE;
+			}
+			r->mbox = mbox;
+			r->reg = reg;
+		}
+		r->val = val[i];
+	}
+}
+
+static void af9033_shadow_invalidate(struct af9033_state *state)
+{
+	state->shadow_cnt = 0;
+	state->shadow_next = 0;
+}
+
 /* write multiple registers */
 static int af9033_write_regs(struct af9033_state *state, u8 mbox, u16 reg,
 	u8 *val, u8 len)
 {
-	u8 buf[3+len];
+	u8 buf[3 + 255];
 	struct i2c_msg msg = {
 		.addr = state->config.demod_address,
 		.flags = 0,
-		.len = sizeof(buf),
+		.len = 3 + len,
 		.buf = buf };
 
 	buf[0] = mbox;
@@ -81,6 +200,7 @@ static int af9033_write_regs(struct af9033_state *state, u8 mbox, u16 reg,
 		warn("I2C write failed reg:%04x len:%d", reg, len);
 		return -EREMOTEIO;
 	}
+	af9033_shadow_set(state, mbox, reg, val, len);
 	return 0;
 }
 
@@ -124,6 +244,171 @@ static int af9033_read_reg(struct af9033_state *state, u8 mbox, u16 reg,
 	return af9033_read_regs(state, mbox, reg, val, 1);
 }
 
+/* write register table, consecutive addresses are written as one burst */
+static int af9033_write_regdesc(struct af9033_state *state, u8 mbox,
+	const struct regdesc *tab, int len)
+{
+	int ret, i, j, max;
+	u8 buf[255];
+
+	max = clamp_t(int, state->config.i2c_wr_max, 1, sizeof(buf));
+
+	for (i = 0; i < len; i = j) {
+		buf[0] = tab[i].val;
+		for (j = i + 1; j < len && j - i < max; j++) {
+			if (tab[j].addr != tab[j - 1].addr + 1)
+				break;
+			buf[j - i] = tab[j].val;
+		}
+
+		ret = af9033_write_regs(state, mbox, tab[i].addr, buf, j - i);
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* write list of single registers, one I2C transfer per 16 registers */
+static int af9033_write_reg_list(struct af9033_state *state,
+	const struct af9033_reg_val *tab, int num)
+{
+	struct i2c_msg msg[AF9033_REG_LIST_MAX];
+	u8 buf[AF9033_REG_LIST_MAX][4];
+	int i, n;
+
+	for (; num > 0; num -= n, tab += n) {
+		n = min(num, AF9033_REG_LIST_MAX);
+		for (i = 0; i < n; i++) {
+			buf[i][0] = tab[i].mbox;
+			buf[i][1] = tab[i].reg >> 8;
+			buf[i][2] = tab[i].reg & 0xff;
+			buf[i][3] = tab[i].val;
+			msg[i].addr = state->config.demod_address;
+			msg[i].flags = 0;
+			msg[i].len = sizeof(buf[i]);
+			msg[i].buf = buf[i];
+		}
+
+		if (i2c_transfer(state->i2c, msg, n) != n) {
+			warn("I2C write list failed reg:%04x", tab[0].reg);
+			return -EREMOTEIO;
+		}
+
+		for (i = 0; i < n; i++)
+			af9033_shadow_set(state, tab[i].mbox, tab[i].reg,
+				&tab[i].val, 1);
+	}
+	return 0;
+}
+
+/* read list of single registers, one I2C transfer per 16 registers */
+static int af9033_read_reg_list(struct af9033_state *state,
+	struct af9033_reg_val *tab, int num)
+{
+	struct i2c_msg msg[2 * AF9033_REG_LIST_MAX];
+	u8 buf[AF9033_REG_LIST_MAX][3];
+	int i, n;
+
+	for (; num > 0; num -= n, tab += n) {
+		n = min(num, AF9033_REG_LIST_MAX);
+		for (i = 0; i < n; i++) {
+			buf[i][0] = tab[i].mbox;
+			buf[i][1] = tab[i].reg >> 8;
+			buf[i][2] = tab[i].reg & 0xff;
+			msg[2 * i].addr = state->config.demod_address;
+			msg[2 * i].flags = 0;
+			msg[2 * i].len = sizeof(buf[i]);
+			msg[2 * i].buf = buf[i];
+			msg[2 * i + 1].addr = state->config.demod_address;
+			msg[2 * i + 1].flags = I2C_M_RD;
+			msg[2 * i + 1].len = 1;
+			msg[2 * i + 1].buf = &tab[i].val;
+		}
+
+		if (i2c_transfer(state->i2c, msg, 2 * n) != 2 * n) {
+			warn("I2C read list failed reg:%04x", tab[0].reg);
+			return -EREMOTEIO;
+		}
+	}
+	return 0;
+}
+
+/* write register bits in given order, registers are read and written as
+   lists, len 8 writes whole register without reading it */
+static int af9033_write_reg_bits_tab(struct af9033_state *state,
+	const struct af9033_reg_bits *tab, int num)
+{
+	struct af9033_reg_val rd[AF9033_REG_LIST_MAX];
+	struct af9033_reg_val wr[AF9033_REG_LIST_MAX];
+	int ret, i, j, nrd = 0;
+	u8 mask;
+
+	if (num > AF9033_REG_LIST_MAX)
+		return -EINVAL;
+
+	/* read registers which are not fully overwritten, once */
+	for (i = 0; i < num; i++) {
+		if (tab[i].len == 8)
+			continue;
+		for (j = 0; j < nrd; j++) {
+			if (rd[j].mbox == tab[i].mbox && rd[j].reg == tab[i].reg)
+				break;
+		}
+		if (j < nrd)
+			continue;
+
+		rd[nrd].mbox = tab[i].mbox;
+		rd[nrd].reg = tab[i].reg;
+		nrd++;
+	}
+
+	/* shadowed registers are not read again, the rest is moved first */
+	for (i = 0, j = 0; i < nrd; i++) {
+		if (af9033_shadow_get(state, rd[i].mbox, rd[i].reg,
+			&rd[i].val))
+			continue;
+		swap(rd[i], rd[j]);
+		j++;
+	}
+
+	ret = af9033_read_reg_list(state, rd, j);
+	if (ret)
+		return ret;
+
+	/* apply bits in order, latest value of the register is used */
+	for (i = 0; i < num; i++) {
+		wr[i].mbox = tab[i].mbox;
+		wr[i].reg = tab[i].reg;
+
+		if (tab[i].len == 8) {
+			wr[i].val = tab[i].val;
+			continue;
+		}
+
+		for (j = i - 1; j >= 0; j--) {
+			if (wr[j].mbox == wr[i].mbox && wr[j].reg == wr[i].reg)
+				break;
+		}
+		if (j >= 0) {
+			wr[i].val = wr[j].val;
+		} else {
+			for (j = 0; j < nrd; j++) {
+				if (rd[j].mbox == wr[i].mbox &&
+					rd[j].reg == wr[i].reg)
+					break;
+			}
+			wr[i].val = rd[j].val;
+		}
+
+		mask = regmask[tab[i].len - 1] << tab[i].pos;
+		wr[i].val = (wr[i].val & ~mask) |
+			((tab[i].val << tab[i].pos) & mask);
+	}
+
+	return af9033_write_reg_list(state, wr, num);
+}
+
 /* write single register bits */
 static int af9033_write_reg_bits(struct af9033_state *state, u8 mbox, u16 reg,
 	u8 pos, u8 len, u8 val)
@@ -131,9 +416,11 @@ static int af9033_write_reg_bits(struct af9033_state *state, u8 mbox, u16 reg,
 	int ret;
 	u8 tmp, mask;
 
-	ret = af9033_read_reg(state, mbox, reg, &tmp);
-	if (ret)
-		return ret;
+	if (!af9033_shadow_get(state, mbox, reg, &tmp)) {
+		ret = af9033_read_reg(state, mbox, reg, &tmp);
+		if (ret)
+			return ret;
+	}
 
 	mask = regmask[len - 1] << pos;
 	tmp = (tmp & ~mask) | ((val << pos) & mask);
@@ -727,8 +1014,7 @@ static int af9033_set_coeff(struct af9033_state *state, fe_bandwidth_t bw)
 	buf[i++] = (u8) ((fftindex_bfsfcw_ratio &     0x00ff));
 	buf[i++] = (u8) ((fftindex_bfsfcw_ratio &     0xff00) >> 8);
 
-	deb_info("%s: coeff:", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("coeff: ", buf, sizeof(buf));
 
 	/* program */
 	return af9033_write_regs(state, OFDM, api_cfoe_NS_2048_coeff1_25_24,
@@ -749,8 +1035,7 @@ static int af9033_set_crystal_ctrl(struct af9033_state *state)
 	buf[2] = (u8) ((crystal_cw & 0x00ff0000) >> 16);
 	buf[3] = (u8) ((crystal_cw & 0xff000000) >> 24);
 
-	deb_info("%s: crystal_cw:", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("crystal_cw: ", buf, sizeof(buf));
 
 	/* program */
 	return af9033_write_regs(state, OFDM, api_crystal_clk_7_0, buf,
@@ -769,8 +1054,7 @@ static int af9033_set_adc_ctrl(struct af9033_state *state)
 	buf[1] = (u8) ((adc_cw & 0x0000ff00) >> 8);
 	buf[2] = (u8) ((adc_cw & 0x00ff0000) >> 16);
 
-	deb_info("%s: adc_cw:", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("adc_cw: ", buf, sizeof(buf));
 
 	/* program */
 	return af9033_write_regs(state, OFDM, p_reg_f_adc_7_0, buf,
@@ -815,8 +1099,7 @@ static int af9033_set_freq_ctrl(struct af9033_state *state)
 	buf[1] = (u8) ((freq_cw & 0x0000ff00) >> 8);
 	buf[2] = (u8) ((freq_cw & 0x007f0000) >> 16);
 
-	deb_info("%s: freq_cw:", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("freq_cw: ", buf, sizeof(buf));
 
 	/* program */
 	return af9033_write_regs(state, OFDM, api_bfs_fcw_7_0, buf,
@@ -825,17 +1108,77 @@ static int af9033_set_freq_ctrl(struct af9033_state *state)
 static void af9033_release(struct dvb_frontend *fe)
 {
 	struct af9033_state *state = fe->demodulator_priv;
+
+	cancel_delayed_work_sync(&state->sleep_work);
 	kfree(state);
 }
 
+/* registers of the last init are still there when the firmware variable
+   holding tuner type and the last non-zero OFSM setting read back, both are
+   lost when the firmware is rebooted or the chip loses power */
+static bool af9033_regs_kept(struct af9033_state *state)
+{
+	struct af9033_reg_val tab[2];
+	int i;
+
+	tab[0].mbox = LINK;
+	tab[0].reg = p_reg_link_ofsm_dummy_15_8;
+	tab[1].mbox = OFDM;
+	for (i = ARRAY_SIZE(ofsm_init) - 1; i > 0; i--) {
+		if (ofsm_init[i].val && !af9033_reg_volatile(OFDM,
+			ofsm_init[i].addr))
+			break;
+	}
+	tab[1].reg = ofsm_init[i].addr;
+
+	if (af9033_read_reg_list(state, tab, ARRAY_SIZE(tab)))
+		return false;
+
+	deb_info("%s: tuner:%02x ofsm:%02x\n", __func__, tab[0].val,
+		tab[1].val);
+
+	return tab[0].val == state->config.tuner &&
+		tab[1].val == ofsm_init[i].val;
+}
+
+/* undo what af9033_sleep() did */
+static int af9033_wakeup(struct af9033_state *state)
+{
+	int ret;
+
+	/* power on */
+	ret = af9033_write_reg_bits(state, OFDM, p_reg_afe_mem0, 3, 1, 0);
+	if (ret)
+		return ret;
+
+	return af9033_write_reg(state, OFDM, api_suspend_flag, 0);
+}
+
 static int af9033_init(struct dvb_frontend *fe)
 {
 	struct af9033_state *state = fe->demodulator_priv;
-	int ret, i, len;
+	int ret, len, n;
 	u8 tmp0, tmp1;
 	struct regdesc *init;
+	struct af9033_reg_bits tab[AF9033_REG_LIST_MAX];
 	deb_info("%s\n", __func__);
 
+	/* reopen during power down, it is not finished */
+	if (cancel_delayed_work_sync(&state->sleep_work))
+		deb_info("%s: power down cancelled\n", __func__);
+
+	if (af9033_fast_resume && state->init_done && af9033_regs_kept(state)) {
+		deb_info("%s: registers kept, waking up only\n", __func__);
+		ret = af9033_wakeup(state);
+		if (!ret)
+			return 0;
+	}
+	state->init_done = 0;
+
+	/* registers may be lost while sleeping or suspended */
+	af9033_shadow_invalidate(state);
+	state->gate = -1;
+
 	/* power on */
 	ret = af9033_write_reg_bits(state, OFDM, p_reg_afe_mem0, 3, 1, 0);
 	if (ret)
@@ -845,21 +1188,21 @@ static int af9033_init(struct dvb_frontend *fe)
 	if (ret)
 		goto error;
 
-	/* tell to the firmware type of the tuner */
-	ret = af9033_write_reg(state, LINK, p_reg_link_ofsm_dummy_15_8,
-		state->config.tuner);
-	if (ret)
-		goto error;
+#define AF9033_BITS(_mbox, _reg, _val) \
+	tab[n++] = (struct af9033_reg_bits) {_mbox, p_##_reg, _reg##_pos, \
+		_reg##_len, _val}
+#define AF9033_BYTE(_mbox, _reg, _val) \
+	tab[n++] = (struct af9033_reg_bits) {_mbox, _reg, 0, 8, _val}
 
+	n = 0;
+	/* tell to the firmware type of the tuner */
+	AF9033_BYTE(LINK, p_reg_link_ofsm_dummy_15_8, state->config.tuner);
 	/* set read-update bit for constellation */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_feq_read_update,
-		reg_feq_read_update_pos, reg_feq_read_update_len, 1);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(OFDM, reg_feq_read_update, 1);
 	/* enable FEC monitor */
-	ret = af9033_write_reg_bits(state, OFDM, p_fec_vtb_rsd_mon_en,
-		fec_vtb_rsd_mon_en_pos, fec_vtb_rsd_mon_en_len, 1);
+	AF9033_BITS(OFDM, fec_vtb_rsd_mon_en, 1);
+
+	ret = af9033_write_reg_bits_tab(state, tab, n);
 	if (ret)
 		goto error;
 
@@ -873,82 +1216,38 @@ static int af9033_init(struct dvb_frontend *fe)
 	if (ret)
 		goto error;
 
+	n = 0;
 	/* enable DVB-T interrupt */
-	ret = af9033_write_reg_bits(state, LINK, p_reg_dvbt_inten,
-		reg_dvbt_inten_pos, reg_dvbt_inten_len, 1);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(LINK, reg_dvbt_inten, 1);
 	/* enable DVB-T mode */
-	ret = af9033_write_reg_bits(state, LINK, p_reg_dvbt_en,
-		reg_dvbt_en_pos, reg_dvbt_en_len, 1);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(LINK, reg_dvbt_en, 1);
 	/* set dca_upper_chip */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_dca_upper_chip,
-		reg_dca_upper_chip_pos, reg_dca_upper_chip_len, 0);
-	if (ret)
-		goto error;
-
-	ret = af9033_write_reg_bits(state, LINK, p_reg_top_hostb_dca_upper,
-		reg_top_hostb_dca_upper_pos, reg_top_hostb_dca_upper_len, 0);
-	if (ret)
-		goto error;
-
-	ret = af9033_write_reg_bits(state, LINK, p_reg_top_hosta_dca_upper,
-		reg_top_hosta_dca_upper_pos, reg_top_hosta_dca_upper_len, 0);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(OFDM, reg_dca_upper_chip, 0);
+	AF9033_BITS(LINK, reg_top_hostb_dca_upper, 0);
+	AF9033_BITS(LINK, reg_top_hosta_dca_upper, 0);
 	/* set dca_lower_chip */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_dca_lower_chip,
-		reg_dca_lower_chip_pos, reg_dca_lower_chip_len, 0);
-	if (ret)
-		goto error;
-
-	ret = af9033_write_reg_bits(state, LINK, p_reg_top_hostb_dca_lower,
-		reg_top_hostb_dca_lower_pos, reg_top_hostb_dca_lower_len, 0);
-	if (ret)
-		goto error;
-
-	ret = af9033_write_reg_bits(state, LINK, p_reg_top_hosta_dca_lower,
-		reg_top_hosta_dca_lower_pos, reg_top_hosta_dca_lower_len, 0);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(OFDM, reg_dca_lower_chip, 0);
+	AF9033_BITS(LINK, reg_top_hostb_dca_lower, 0);
+	AF9033_BITS(LINK, reg_top_hosta_dca_lower, 0);
 	/* set phase latch */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_dca_platch,
-		reg_dca_platch_pos, reg_dca_platch_len, 0);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(OFDM, reg_dca_platch, 0);
 	/* set fpga latch */
-	ret = af9033_write_reg(state, OFDM, p_reg_dca_fpga_latch, 0);
-	if (ret)
-		goto error;
-
+	AF9033_BYTE(OFDM, p_reg_dca_fpga_latch, 0);
 	/* set stand alone */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_dca_stand_alone,
-		reg_dca_stand_alone_pos, reg_dca_stand_alone_len, 1);
-	if (ret)
-		goto error;
-
+	AF9033_BITS(OFDM, reg_dca_stand_alone, 1);
 	/* set DCA enable */
-	ret = af9033_write_reg_bits(state, OFDM, p_reg_dca_en, reg_dca_en_pos,
-		reg_dca_en_len, 0);
+	AF9033_BITS(OFDM, reg_dca_en, 0);
+
+	ret = af9033_write_reg_bits_tab(state, tab, n);
 	if (ret)
 		goto error;
 
 	/* load OFSM settings */
 	deb_info("%s: load ofsm settings\n", __func__);
-	len = ARRAY_SIZE(ofsm_init);
-	init = ofsm_init;
-	for (i = 0; i < len; i++) {
-		ret = af9033_write_reg(state, OFDM, init[i].addr, init[i].val);
-		if (ret)
-			goto error;
-	}
+	ret = af9033_write_regdesc(state, OFDM, ofsm_init,
+		ARRAY_SIZE(ofsm_init));
+	if (ret)
+		goto error;
 
 	/* load tuner specific settings */
 	deb_info("%s: load tuner specific settings\n", __func__);
@@ -970,29 +1269,7 @@ static int af9033_init(struct dvb_frontend *fe)
 		init = NULL;
 		break;
 	}
-	for (i = 0; i < len; i++) {
-		ret = af9033_write_reg(state, OFDM, init[i].addr, init[i].val);
-		if (ret)
-			goto error;
-	}
-
-	/* set H/W MPEG2 locked detection **/
-	ret = af9033_write_reg(state, LINK, p_reg_top_lock3_out, 1);
-	if (ret)
-		goto error;
-
-	/* set registers for driving power */
-	ret = af9033_write_reg(state, LINK, p_reg_top_padmiscdr2, 1);
-	if (ret)
-		goto error;
-
-	/* et registers for driving power */
-	ret = af9033_write_reg(state, LINK, p_reg_top_padmiscdr4, 0);
-	if (ret)
-		goto error;
-
-	/* set registers for driving power */
-	ret = af9033_write_reg(state, LINK, p_reg_top_padmiscdr8, 0);
+	ret = af9033_write_regdesc(state, OFDM, init, len);
 	if (ret)
 		goto error;
 
@@ -1012,21 +1289,27 @@ static int af9033_init(struct dvb_frontend *fe)
 	default:
 		break;
 	}
-	ret = af9033_write_reg_bits(state, OFDM, p_mp2if_mpeg_par_mode,
-		mp2if_mpeg_par_mode_pos, mp2if_mpeg_par_mode_len, tmp0);
-	if (ret)
-		goto error;
-	ret = af9033_write_reg_bits(state, OFDM, p_mp2if_mpeg_ser_mode,
-		mp2if_mpeg_ser_mode_pos, mp2if_mpeg_ser_mode_len, tmp1);
+
+	n = 0;
+	/* set H/W MPEG2 locked detection **/
+	AF9033_BYTE(LINK, p_reg_top_lock3_out, 1);
+	/* set registers for driving power */
+	AF9033_BYTE(LINK, p_reg_top_padmiscdr2, 1);
+	AF9033_BYTE(LINK, p_reg_top_padmiscdr4, 0);
+	AF9033_BYTE(LINK, p_reg_top_padmiscdr8, 0);
+	AF9033_BITS(OFDM, mp2if_mpeg_par_mode, tmp0);
+	AF9033_BITS(OFDM, mp2if_mpeg_ser_mode, tmp1);
+	if (state->config.output_mode == AF9033_TS_MODE_SERIAL)
+		AF9033_BITS(LINK, reg_top_hostb_mpeg_ser_mode, 1);
+
+#undef AF9033_BITS
+#undef AF9033_BYTE
+
+	ret = af9033_write_reg_bits_tab(state, tab, n);
 	if (ret)
 		goto error;
 
-	if (state->config.output_mode == AF9033_TS_MODE_SERIAL) {
-		ret = af9033_write_reg_bits(state, LINK, p_reg_top_hostb_mpeg_ser_mode,
-			reg_top_hostb_mpeg_ser_mode_pos, reg_top_hostb_mpeg_ser_mode_len, 1);
-		if (ret)
-			goto error;
-	}
+	state->init_done = 1;
 error:
 	if (ret)
 		deb_info("%s: failed:%d\n", __func__, ret);
@@ -1034,37 +1317,14 @@ error:
 	return ret;
 }
 
-static int af9033_sleep(struct dvb_frontend *fe)
+/* rest of power down, once firmware has stopped OFSM */
+static int af9033_power_off(struct af9033_state *state)
 {
-	struct af9033_state *state = fe->demodulator_priv;
 	int ret;
-	u8 tmp, i;
-	deb_info("%s\n", __func__);
-
-	ret = af9033_write_reg(state, OFDM, api_suspend_flag, 1);
-	if (ret)
-		goto error;
-
-	ret = af9033_write_reg(state, OFDM, api_trigger_ofsm, 0);
-	if (ret)
-		goto error;
-
-	for (i = 0; i < 150; i++) {
-		ret = af9033_read_reg(state, OFDM, api_suspend_flag, &tmp);
-		if (ret)
-			goto error;
-		if (!tmp)
-			break;
-		msleep(10);
-	}
-	if (tmp) {
-		deb_info("%s: power off time outs\n", __func__);
-		return -ETIMEDOUT;
-	}
 
 	ret = af9033_write_reg_bits(state, OFDM, p_reg_afe_mem0, 3, 1, 1);
 	if (ret)
-		goto error;
+		return ret;
 
 	/* fixed current leakage (?) */
 	if (state->config.output_mode != AF9033_TS_MODE_USB) {
@@ -1074,7 +1334,7 @@ static int af9033_sleep(struct dvb_frontend *fe)
 			reg_top_hosta_mpeg_ser_mode_pos,
 			reg_top_hosta_mpeg_ser_mode_len, 0);
 		if (ret)
-			goto error;
+			return ret;
 
 		ret = af9033_write_reg_bits(state, LINK,
 			p_reg_top_hosta_mpeg_par_mode,
@@ -1082,6 +1342,92 @@ static int af9033_sleep(struct dvb_frontend *fe)
 			reg_top_hosta_mpeg_par_mode_len, 1);
 	}
 
+	return ret;
+}
+
+/* poll suspend flag, returns ms to wait before next poll or 0 when powered
+   off, first polls are 1 ms apart and the interval doubles up to
+   AF9033_SLEEP_POLL_MAX_MS, gives up after AF9033_SLEEP_TIMEOUT_MS */
+static int af9033_sleep_poll(struct af9033_state *state)
+{
+	int ret;
+	u8 tmp;
+
+	ret = af9033_read_reg(state, OFDM, api_suspend_flag, &tmp);
+	if (ret)
+		return ret;
+
+	if (tmp) {
+		if (time_after(jiffies, state->sleep_timeout)) {
+			deb_info("%s: power off time outs\n", __func__);
+			return 0;
+		}
+		return min(1U << min_t(u8, state->sleep_polls++, 8),
+			AF9033_SLEEP_POLL_MAX_MS);
+	}
+
+	deb_info("%s: suspended after %u polls\n", __func__,
+		state->sleep_polls + 1);
+	return af9033_power_off(state);
+}
+
+static void af9033_sleep_work(struct work_struct *work)
+{
+	struct af9033_state *state = container_of(to_delayed_work(work),
+		struct af9033_state, sleep_work);
+	int ret;
+
+	while ((ret = af9033_sleep_poll(state)) > 0) {
+		/* jiffy may be 10 ms, shorter intervals are slept here */
+		if (ret >= jiffies_to_msecs(1)) {
+			schedule_delayed_work(&state->sleep_work,
+				msecs_to_jiffies(ret));
+			return;
+		}
+		usleep_range(ret * 1000, ret * 2000);
+	}
+	if (ret)
+		deb_info("%s: failed:%d\n", __func__, ret);
+}
+
+/* finish pending power down now, bridge calls this before it suspends so
+   that no demod command is issued to the suspended device */
+void af9033_sleep_sync(struct dvb_frontend *fe)
+{
+	struct af9033_state *state = fe->demodulator_priv;
+	int ret;
+
+	if (!cancel_delayed_work_sync(&state->sleep_work))
+		return;
+
+	while ((ret = af9033_sleep_poll(state)) > 0)
+		usleep_range(ret * 1000, ret * 2000);
+	if (ret)
+		deb_info("%s: failed:%d\n", __func__, ret);
+}
+EXPORT_SYMBOL(af9033_sleep_sync);
+
+/* power down is started here and finished by af9033_sleep_work(), close
+   does not wait for the firmware */
+static int af9033_sleep(struct dvb_frontend *fe)
+{
+	struct af9033_state *state = fe->demodulator_priv;
+	int ret;
+	deb_info("%s\n", __func__);
+
+	ret = af9033_write_reg(state, OFDM, api_suspend_flag, 1);
+	if (ret)
+		goto error;
+
+	ret = af9033_write_reg(state, OFDM, api_trigger_ofsm, 0);
+	if (ret)
+		goto error;
+
+	state->sleep_polls = 0;
+	state->sleep_timeout = jiffies +
+		msecs_to_jiffies(AF9033_SLEEP_TIMEOUT_MS);
+	schedule_delayed_work(&state->sleep_work, 0);
+
 error:
 	if (ret)
 		deb_info("%s: failed:%d\n", __func__, ret);
@@ -1089,6 +1435,23 @@ error:
 	return ret;
 }
 
+static int af9033_gate_set(struct af9033_state *state, int enable)
+{
+	int ret;
+
+	enable = !!enable;
+	if (state->gate == enable)
+		return 0;
+
+	deb_info("%s: enable:%d\n", __func__, enable);
+
+	ret = af9033_write_reg_bits(state, LINK, p_reg_bypass_host2tuner,
+		reg_bypass_host2tuner_pos, reg_bypass_host2tuner_len, enable);
+	state->gate = ret ? -1 : enable;
+
+	return ret;
+}
+
 #ifdef V4L2_ONLY_DVB_V5
 static int af9033_set_frontend(struct dvb_frontend *fe)
 {
@@ -1101,9 +1464,13 @@ static int af9033_set_frontend(struct dvb_frontend *fe)
 
 	state->frequency = params->frequency;
 
-	/* program tuner */
-	if (fe->ops.tuner_ops.set_params)
+	/* program tuner, all its accesses share one gate open */
+	if (fe->ops.tuner_ops.set_params) {
+		state->gate_hold = 1;
 		fe->ops.tuner_ops.set_params(fe);
+		state->gate_hold = 0;
+		af9033_gate_set(state, 0);
+	}
 
 	/* program CFOE coefficients */
 	ret = af9033_set_coeff(state, params->bandwidth_hz);
@@ -1197,9 +1564,13 @@ static int af9033_set_frontend(struct dvb_frontend *fe,
 
 	state->frequency = params->frequency;
 
-	/* program tuner */
-	if (fe->ops.tuner_ops.set_params)
+	/* program tuner, all its accesses share one gate open */
+	if (fe->ops.tuner_ops.set_params) {
+		state->gate_hold = 1;
 		fe->ops.tuner_ops.set_params(fe, params);
+		state->gate_hold = 0;
+		af9033_gate_set(state, 0);
+	}
 
 	/* program CFOE coefficients */
 	ret = af9033_set_coeff(state, params->u.ofdm.bandwidth);
@@ -1315,8 +1686,7 @@ static int af9033_get_frontend(struct dvb_frontend *fe)
 	if (ret)
 		goto error;
 
-	deb_info("%s: ", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("get_frontend: ", buf, sizeof(buf));
 
 	switch ((buf[CONSTELLATION] >> 0) & 3) {
 	case 0:
@@ -1464,8 +1834,7 @@ static int af9033_get_frontend(struct dvb_frontend *fe,
 	if (ret)
 		goto error;
 
-	deb_info("%s: ", __func__);
-	debug_dump(buf, sizeof(buf), deb_info);
+	deb_dump("get_frontend: ", buf, sizeof(buf));
 
 	switch ((buf[CONSTELLATION] >> 0) & 3) {
 	case 0:
@@ -1738,32 +2107,30 @@ static int af9033_read_status(struct dvb_frontend *fe, fe_status_t *status)
 {
 	struct af9033_state *state = fe->demodulator_priv;
 	int ret = 0;
-	u8 tmp;
+	struct af9033_reg_val tab[] = {
+		{OFDM, api_empty_channel_status, 0},
+		{OFDM, p_fd_tpsd_lock, 0},
+		{OFDM, r_mp2if_sync_byte_locked, 0},
+	};
 	*status = 0;
 
-	/* empty channel; 0:no result, 1:signal, 2:empty */
-	ret = af9033_read_reg(state, OFDM, api_empty_channel_status, &tmp);
+	ret = af9033_read_reg_list(state, tab, ARRAY_SIZE(tab));
 	if (ret)
 		goto error;
-	if (tmp == 0x01) /* have signal */
+
+	/* empty channel; 0:no result, 1:signal, 2:empty */
+	if (tab[0].val == 0x01) /* have signal */
 		*status |= FE_HAS_SIGNAL;
 
-	if (tmp != 0x02) {
+	if (tab[0].val != 0x02) {
 		/* TPS lock */
-		ret = af9033_read_reg_bits(state, OFDM, p_fd_tpsd_lock,
-			fd_tpsd_lock_pos, fd_tpsd_lock_len, &tmp);
-		if (ret)
-			goto error;
-		if (tmp)
+		if ((tab[1].val >> fd_tpsd_lock_pos) &
+			regmask[fd_tpsd_lock_len - 1])
 			*status |= FE_HAS_VITERBI | FE_HAS_CARRIER;
 
 		/* MPEG2 lock */
-		ret = af9033_read_reg_bits(state, OFDM,
-			r_mp2if_sync_byte_locked, mp2if_sync_byte_locked_pos,
-			mp2if_sync_byte_locked_len, &tmp);
-		if (ret)
-			goto error;
-		if (tmp)
+		if ((tab[2].val >> mp2if_sync_byte_locked_pos) &
+			regmask[mp2if_sync_byte_locked_len - 1])
 			*status |= FE_HAS_SYNC | FE_HAS_LOCK;
 	}
 
@@ -1825,13 +2192,16 @@ static int af9033_read_ucblocks(struct dvb_frontend *fe, u32 *ucblocks)
 	return ret;
 }
 
+/* tuner drivers open and close gate around every access, only changes are
+   written and close is left to set_frontend while it runs */
 static int af9033_i2c_gate_ctrl(struct dvb_frontend *fe, int enable)
 {
 	struct af9033_state *state = fe->demodulator_priv;
-	deb_info("%s: enable:%d\n", __func__, enable);
 
-	return af9033_write_reg_bits(state, LINK, p_reg_bypass_host2tuner,
-		reg_bypass_host2tuner_pos, reg_bypass_host2tuner_len, enable);
+	if (!enable && state->gate_hold)
+		return 0;
+
+	return af9033_gate_set(state, enable);
 }
 
 static struct dvb_frontend_ops af9033_ops;
@@ -1852,6 +2222,8 @@ struct dvb_frontend *af9033_attach(const struct af9033_config *config,
 	/* setup the state */
 	state->i2c = i2c;
 	memcpy(&state->config, config, sizeof(struct af9033_config));
+	INIT_DELAYED_WORK(&state->sleep_work, af9033_sleep_work);
+	state->gate = -1;
 
 	/* firmware version */
 	ret = af9033_read_regs(state, LINK, 0x83e9, &buf[0], sizeof(buf) / 2);
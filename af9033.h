@@ -81,6 +81,9 @@ struct af9033_config {
 
 	/* RF spectrum inversion */
 	u8 rf_spec_inv:1;
+
+	/* max data bytes I2C adapter can write at once, 0 = one register */
+	u8 i2c_wr_max;
 };
 
 
@@ -89,6 +92,7 @@ struct af9033_config {
 	(defined(CONFIG_DVB_AF9033_MODULE) && defined(MODULE))
 extern struct dvb_frontend *af9033_attach(const struct af9033_config *config,
 	struct i2c_adapter *i2c);
+extern void af9033_sleep_sync(struct dvb_frontend *fe);
 #else
 static inline struct dvb_frontend *af9033_attach(
 const struct af9033_config *config, struct i2c_adapter *i2c)
@@ -96,6 +100,9 @@ const struct af9033_config *config, struct i2c_adapter *i2c)
 	printk(KERN_WARNING "%s: driver disabled by Kconfig\n", __func__);
 	return NULL;
 }
+static inline void af9033_sleep_sync(struct dvb_frontend *fe)
+{
+}
 #endif /* CONFIG_DVB_AF9033 */
 
 #endif /* AF9033_H */
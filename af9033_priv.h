@@ -27,17 +27,21 @@
 
 #define LOG_PREFIX "af9033"
 
-#define dprintk(var, level, args...) \
-	    do { if ((var & level)) printk(args); } while (0)
+#include "debug_key.h"
 
-#define debug_dump(b, l, func) {\
-	int loop_; \
-	for (loop_ = 0; loop_ < l; loop_++) \
-		func("%02x ", b[loop_]); \
-	func("\n");\
-}
+#define dprintk(var, level, args...) \
+	do { \
+		if (debug_level(var, level)) \
+			printk(args); \
+	} while (0)
 
 #define deb_info(args...) dprintk(af9033_debug, 0x01, args)
+#define deb_dump(prefix, buf, len) \
+	do { \
+		if (debug_level(af9033_debug, 0x01)) \
+			print_hex_dump(KERN_DEBUG, LOG_PREFIX ": " prefix, \
+				DUMP_PREFIX_NONE, 32, 1, buf, len, false); \
+	} while (0)
 
 #undef err
 #define err(f, arg...)  printk(KERN_ERR     LOG_PREFIX": " f "\n" , ## arg)
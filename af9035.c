@@ -28,62 +28,280 @@
 #include "mxl5007t.h"
 #include "tda18218.h"
 #include <linux/version.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/crc32.h>
+#include <linux/pm_runtime.h>
+
+#define CREATE_TRACE_POINTS
+#include "af9035_trace.h"
 
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3,2,0)) || ((defined V4L2_VERSION) && (V4L2_VERSION >= 196608))
 #define V4L2_REFACTORED_MFE_CODE
 #endif
 
-static int dvb_usb_af9035_debug;
-module_param_named(debug, dvb_usb_af9035_debug, int, 0644);
+DEFINE_DEBUG_PARAM(debug, dvb_usb_af9035_debug);
 MODULE_PARM_DESC(debug, "set debugging level" DVB_USB_DEBUG_STATUS);
 DVB_DEFINE_MOD_OPT_ADAPTER_NR(adapter_nr);
 
-static DEFINE_MUTEX(af9035_usb_mutex);
+static int af9035_cmd_inflight = 4;
+module_param_named(cmd_inflight, af9035_cmd_inflight, int, 0644);
+MODULE_PARM_DESC(cmd_inflight, "max commands in flight per device (1-16)");
+
+static int af9035_scatter = 1;
+module_param_named(scatter, af9035_scatter, int, 0644);
+MODULE_PARM_DESC(scatter, "use scatter read / write commands (default:on)");
+
+static int af9035_short_cmd = 1;
+module_param_named(short_cmd, af9035_short_cmd, int, 0644);
+MODULE_PARM_DESC(short_cmd, "use short register commands (default:on)");
+
+static int af9035_generic_i2c = 1;
+module_param_named(generic_i2c, af9035_generic_i2c, int, 0644);
+MODULE_PARM_DESC(generic_i2c, "use generic I2C commands for tuner when it saves commands (default:on)");
+
+static int af9035_async_probe = 1;
+module_param_named(async_probe, af9035_async_probe, int, 0644);
+MODULE_PARM_DESC(async_probe, "init devices in parallel (default:on)");
+
+static int af9035_autosuspend_ms = 2000;
+module_param_named(autosuspend_ms, af9035_autosuspend_ms, int, 0444);
+MODULE_PARM_DESC(autosuspend_ms, "idle time before selective suspend, 0 disables (default:2000)");
+
+static DEFINE_MUTEX(af9035_dev_list_mutex);
+static LIST_HEAD(af9035_dev_list);
+
+/* adapter registration order, under af9035_dev_list_mutex */
+static unsigned int af9035_probe_seq;
+static unsigned int af9035_probe_turn;
+static DECLARE_WAIT_QUEUE_HEAD(af9035_probe_wq);
 
-static struct af9035_config af9035_config;
 static struct dvb_usb_device_properties af9035_properties[1];
 static int af9035_properties_count = ARRAY_SIZE(af9035_properties);
 
-static struct af9033_config af9035_af9033_config[] = {
+static const struct af9033_config af9035_af9033_config[] = {
 	{
 		.demod_address = 0,
 		.tuner_address = 0,
 		.output_mode = AF9033_TS_MODE_USB,
+		.i2c_wr_max = AF9035_DEMOD_WR_MAX,
 	}, {
 		.demod_address = 0,
 		.tuner_address = 0,
 		.output_mode = AF9033_TS_MODE_SERIAL,
+		.i2c_wr_max = AF9035_DEMOD_WR_MAX,
 	}
 };
 
 static u8 regmask[8] = {0x01, 0x03, 0x07, 0x0f, 0x1f, 0x3f, 0x7f, 0xff};
 
-static int af9035_rw_udev(struct usb_device *udev, struct af9035_req *req)
+/* registers changed by the hardware or the firmware, never shadowed */
+static const struct {
+	u8 mbox;
+	u16 first;
+	u16 last;
+} af9035_volatile_regs[] = {
+	{LINK, 0x83e9, 0x83ec}, /* firmware version */
+	{LINK, r_io_mux_pwron_clk_strap, r_io_mux_pwron_clk_strap},
+	{OFDM, 0x0000, 0x00ff}, /* OFSM firmware variables, api_* */
+};
+
+/* cmd_lock must be held */
+static void af9035_cmd_finish(struct af9035_cmd *cmd, u8 flags)
+{
+	u8 done = AF9035_CMD_TX_DONE | AF9035_CMD_RX_DONE;
+
+	cmd->flags |= flags;
+	if ((cmd->flags & done) == done) {
+		cmd->t_done = ktime_get();
+		complete(&cmd->done);
+	}
+}
+
+/* fail all commands waiting for reply, cmd_lock must be held */
+static void af9035_cmd_flush(struct af9035_state *state, int status)
 {
-#define BUF_SIZE 63
-	int act_len, ret;
-	u8 buf[BUF_SIZE];
+	struct af9035_cmd *cmd, *tmp;
+
+	list_for_each_entry_safe(cmd, tmp, &state->cmd_pending, list) {
+		list_del_init(&cmd->list);
+		cmd->status = status;
+		af9035_cmd_finish(cmd, AF9035_CMD_RX_DONE);
+	}
+}
+
+static void af9035_rx_complete(struct urb *urb)
+{
+	struct af9035_state *state = urb->context;
+	struct af9035_cmd *cmd;
+	u8 *buf = state->rx_buf;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&state->cmd_lock, flags);
+
+	if (urb->status) {
+		if (urb->status != -ENOENT && urb->status != -ESHUTDOWN)
+			err("recv bulk message failed:%d", urb->status);
+		/* killed by recovery, commands may be sent again */
+		af9035_cmd_flush(state, urb->status == -ENOENT ?
+			-ECONNRESET : -EPROTO);
+		state->rx_active = 0;
+		goto exit_unlock;
+	}
+
+	deb_xfer_dump("<<< ", buf, urb->actual_length);
+
+	if (urb->actual_length < 3) {
+		err("too short reply:%d", urb->actual_length);
+		goto resubmit;
+	}
+
+	list_for_each_entry(cmd, &state->cmd_pending, list) {
+		if (cmd->seq != buf[1])
+			continue;
+
+		list_del_init(&cmd->list);
+
+		/* check status */
+		if (buf[2]) {
+			/* tuner NAKs are reported by tuner drivers */
+			if (cmd->req.cmd == CMD_REG_TUNER_READ ||
+				cmd->req.cmd == CMD_GENERIC_READ)
+				deb_xfer("%s: command:%02x failed:%d\n",
+					__func__, cmd->req.cmd, buf[2]);
+			else
+				err("command:%02x failed:%d", cmd->req.cmd,
+					buf[2]);
+			cmd->status = -EIO;
+		} else if (cmd->req.rlen) {
+			/* read request, copy returned data to return buf */
+			if (urb->actual_length < 3 + cmd->req.rlen)
+				cmd->status = -EPROTO;
+			else
+				memcpy(cmd->req.rbuf, &buf[3], cmd->req.rlen);
+		}
+		af9035_cmd_finish(cmd, AF9035_CMD_RX_DONE);
+		goto resubmit;
+	}
+	deb_xfer("%s: no command waiting for seq:%02x\n", __func__, buf[1]);
+
+resubmit:
+	if (list_empty(&state->cmd_pending)) {
+		state->rx_active = 0;
+		goto exit_unlock;
+	}
+
+	ret = usb_submit_urb(urb, GFP_ATOMIC);
+	if (ret) {
+		err("recv bulk submit failed:%d", ret);
+		af9035_cmd_flush(state, -EPROTO);
+		state->rx_active = 0;
+	}
+exit_unlock:
+	spin_unlock_irqrestore(&state->cmd_lock, flags);
+}
+
+static void af9035_tx_complete(struct urb *urb)
+{
+	struct af9035_cmd *cmd = urb->context;
+	struct af9035_state *state = cmd->state;
+	unsigned long flags;
+
+	spin_lock_irqsave(&state->cmd_lock, flags);
+
+	if (urb->status || urb->actual_length != urb->transfer_buffer_length) {
+		err("bulk message failed:%d (%d/%d)", urb->status,
+			urb->transfer_buffer_length, urb->actual_length);
+		cmd->status = urb->status ? urb->status : -EPROTO;
+		/* no reply is coming for this one */
+		if (!(cmd->flags & AF9035_CMD_RX_DONE)) {
+			list_del_init(&cmd->list);
+			cmd->flags |= AF9035_CMD_RX_DONE;
+		}
+	}
+	af9035_cmd_finish(cmd, AF9035_CMD_TX_DONE);
+
+	spin_unlock_irqrestore(&state->cmd_lock, flags);
+}
+
+/* take command from the pool, NULL when the in-flight limit is reached,
+   max 0 means limit set by module param */
+static struct af9035_cmd *af9035_cmd_get(struct af9035_state *state,
+	unsigned int max)
+{
+	struct af9035_cmd *cmd = NULL;
+	int i;
+
+	if (!max)
+		max = af9035_cmd_inflight;
+	max = clamp_val(max, 1, AF9035_CMD_INFLIGHT_MAX);
+
+	spin_lock_irq(&state->cmd_lock);
+	if (state->cmd_inflight < max) {
+		i = find_first_zero_bit(&state->cmd_used,
+			AF9035_CMD_INFLIGHT_MAX);
+		__set_bit(i, &state->cmd_used);
+		state->cmd_inflight++;
+		cmd = &state->cmd_pool[i];
+	}
+	spin_unlock_irq(&state->cmd_lock);
+
+	return cmd;
+}
+
+static void af9035_cmd_put(struct af9035_cmd *cmd)
+{
+	struct af9035_state *state = cmd->state;
+
+	spin_lock_irq(&state->cmd_lock);
+	__clear_bit(cmd - state->cmd_pool, &state->cmd_used);
+	state->cmd_inflight--;
+	spin_unlock_irq(&state->cmd_lock);
+
+	wake_up(&state->cmd_wait);
+}
+
+/* queue command to the device, does not wait for reply */
+static int af9035_cmd_submit(struct af9035_cmd *cmd, struct af9035_req *req)
+{
+	struct af9035_state *state = cmd->state;
+	int ret;
+	u8 *buf = cmd->buf;
 	u32 msg_len;
-	static u8 seq; /* packet sequence number */
 	u16 checksum = 0;
 	u8 i;
 
 	/* buffer overflow check */
-	if (req->wlen > (BUF_SIZE - 6) || req->rlen > (BUF_SIZE - 5)) {
+	if (req->wlen > (AF9035_BUF_SIZE - 6) ||
+		req->rlen > (AF9035_BUF_SIZE - 5)) {
 		err("too much data wlen:%d rlen:%d", req->wlen, req->rlen);
 		return -EINVAL;
 	}
 
-	if (mutex_lock_interruptible(&af9035_usb_mutex) < 0)
-		return -EAGAIN;
+	INIT_LIST_HEAD(&cmd->list);
+	init_completion(&cmd->done);
+	cmd->req = *req;
+	cmd->flags = 0;
+	cmd->status = 0;
 
 	buf[0] = req->wlen + 3 + 2; /* 3 header + 2 checksum */
 	buf[1] = req->mbox;
 	buf[2] = req->cmd;
-	buf[3] = seq++;
 	if (req->wlen)
 		memcpy(&buf[4], req->wbuf, req->wlen);
 
+	msg_len = buf[0]+1;
+
+	usb_fill_bulk_urb(cmd->urb, state->udev,
+		usb_sndbulkpipe(state->udev, 0x02), buf, msg_len,
+		af9035_tx_complete, cmd);
+
+	spin_lock_irq(&state->cmd_lock);
+
+	cmd->seq = state->seq++;
+	buf[3] = cmd->seq;
+
 	/* calc and add checksum */
 	for (i = 1; i < buf[0]-1; i++) {
 		if (i % 2)
@@ -96,140 +314,1327 @@ static int af9035_rw_udev(struct usb_device *udev, struct af9035_req *req)
 	buf[buf[0]-1] = (checksum >> 8);
 	buf[buf[0]-0] = (checksum & 0xff);
 
-	msg_len = buf[0]+1;
+	deb_xfer_dump(">>> ", buf, msg_len);
 
-	deb_xfer(">>> ");
-	debug_dump(buf, msg_len, deb_xfer);
+	/* no ack for those packets */
+	if (req->cmd == CMD_FW_DOWNLOAD)
+		cmd->flags |= AF9035_CMD_RX_DONE;
+	else
+		list_add_tail(&cmd->list, &state->cmd_pending);
 
 	/* send req */
-	ret = usb_bulk_msg(udev, usb_sndbulkpipe(udev, 0x02), buf, msg_len,
-	&act_len, AF9035_USB_TIMEOUT);
+	cmd->t_submit = ktime_get();
+	ret = usb_submit_urb(cmd->urb, GFP_ATOMIC);
+	if (ret) {
+		err("bulk message failed:%d (%d/0)", ret, msg_len);
+		list_del_init(&cmd->list);
+		goto exit_unlock;
+	}
+
+	/* receive ack and data if read req */
+	if (!state->rx_active && !list_empty(&state->cmd_pending)) {
+		ret = usb_submit_urb(state->rx_urb, GFP_ATOMIC);
+		if (ret) {
+			err("recv bulk submit failed:%d", ret);
+			/* tx urb completes on its own, reply is lost */
+			list_del_init(&cmd->list);
+			cmd->flags |= AF9035_CMD_RX_DONE;
+			cmd->status = -EPROTO;
+			ret = 0;
+		} else {
+			state->rx_active = 1;
+		}
+	}
+exit_unlock:
+	spin_unlock_irq(&state->cmd_lock);
+
+	return ret;
+}
+
+/* trace finished command and add it to latency statistics */
+static void af9035_cmd_account(struct af9035_cmd *cmd, int status)
+{
+	struct af9035_state *state = cmd->state;
+	struct af9035_cmd_stat *stat;
+	u32 queue_us, wire_us;
+	int i;
+
+	queue_us = ktime_to_us(ktime_sub(cmd->t_submit, cmd->t_queue));
+	wire_us = ktime_to_us(ktime_sub(cmd->t_done, cmd->t_submit));
+
+	trace_af9035_cmd(state->udev->devnum, cmd->req.cmd, cmd->req.mbox,
+		cmd->seq, cmd->req.wlen, cmd->req.rlen, queue_us, wire_us,
+		status);
+
+	stat = &state->stat[min_t(u8, cmd->req.cmd, AF9035_STAT_CMDS - 1)];
+	i = clamp_t(int, fls(wire_us) - 6, 0, AF9035_STAT_BUCKETS - 1);
+
+	spin_lock_irq(&state->cmd_lock);
+	stat->count++;
+	if (status)
+		stat->errors++;
+	stat->total_us += wire_us;
+	stat->max_us = max(stat->max_us, wire_us);
+	stat->hist[i]++;
+	spin_unlock_irq(&state->cmd_lock);
+}
+
+/* register commands get timeout from observed latency, others may take
+   long on firmware side and use the static one */
+static unsigned long af9035_cmd_timeout(struct af9035_cmd *cmd)
+{
+	struct af9035_state *state = cmd->state;
+	u32 ms = AF9035_USB_TIMEOUT;
+
+	switch (cmd->req.cmd) {
+	case CMD_REG_DEMOD_READ:
+	case CMD_REG_DEMOD_WRITE:
+	case CMD_REG_TUNER_READ:
+	case CMD_REG_TUNER_WRITE:
+	case CMD_SCATTER_READ:
+	case CMD_SCATTER_WRITE:
+	case CMD_GENERIC_READ:
+	case CMD_GENERIC_WRITE:
+		spin_lock_irq(&state->cmd_lock);
+		if (state->rtt_samples >= AF9035_RTT_SAMPLES_MIN)
+			ms = (state->srtt_us + 4 * state->rttvar_us) / 1000;
+		spin_unlock_irq(&state->cmd_lock);
+		ms = clamp_t(u32, ms, AF9035_TIMEOUT_MIN, AF9035_USB_TIMEOUT);
+		break;
+	}
+
+	return msecs_to_jiffies(ms);
+}
+
+/* smoothed latency and its variation, as TCP does for RTO */
+static void af9035_rtt_update(struct af9035_state *state, u32 rtt_us)
+{
+	u32 delta;
+
+	spin_lock_irq(&state->cmd_lock);
+	if (!state->rtt_samples) {
+		state->srtt_us = rtt_us;
+		state->rttvar_us = rtt_us / 2;
+	} else {
+		delta = state->srtt_us > rtt_us ? state->srtt_us - rtt_us :
+			rtt_us - state->srtt_us;
+		state->rttvar_us = (3 * state->rttvar_us + delta) / 4;
+		state->srtt_us = (7 * state->srtt_us + rtt_us) / 8;
+	}
+	if (state->rtt_samples < AF9035_RTT_SAMPLES_MIN)
+		state->rtt_samples++;
+	spin_unlock_irq(&state->cmd_lock);
+}
+
+/* reply did not come, get rid of it so it can't be taken for a reply of a
+   later command and make sure reception runs again */
+static void af9035_recover(struct af9035_state *state)
+{
+	int ret;
+
+	mutex_lock(&state->recover_lock);
+
+	spin_lock_irq(&state->cmd_lock);
+	state->seq += 0x80;
+	spin_unlock_irq(&state->cmd_lock);
+
+	/* commands still waiting for reply are failed with -ECONNRESET */
+	usb_kill_urb(state->rx_urb);
+
+	ret = usb_clear_halt(state->udev, usb_rcvbulkpipe(state->udev, 0x81));
 	if (ret)
-		err("bulk message failed:%d (%d/%d)", ret, msg_len, act_len);
-	else
-		if (act_len != msg_len)
-			ret = -EIO; /* all data is not send */
+		err("clear halt failed:%d", ret);
+
+	mutex_unlock(&state->recover_lock);
+}
+
+/* command can be sent again without side effects */
+static bool af9035_cmd_idempotent(u8 cmd)
+{
+	switch (cmd) {
+	case CMD_REG_DEMOD_READ:
+	case CMD_REG_TUNER_READ:
+	case CMD_REG_EEPROM_READ:
+	case CMD_SCATTER_READ:
+	case CMD_QUERYINFO:
+		return true;
+	}
+
+	return false;
+}
+
+static int af9035_cmd_wait_once(struct af9035_cmd *cmd, unsigned long timeout)
+{
+	struct af9035_state *state = cmd->state;
+	int ret;
+
+	if (!wait_for_completion_timeout(&cmd->done, timeout)) {
+		err("command:%02x seq:%02x timed out", cmd->req.cmd, cmd->seq);
+
+		spin_lock_irq(&state->cmd_lock);
+		if (!(cmd->flags & AF9035_CMD_RX_DONE)) {
+			list_del_init(&cmd->list);
+			cmd->flags |= AF9035_CMD_RX_DONE;
+		}
+		spin_unlock_irq(&state->cmd_lock);
+
+		/* waits tx completion handler, URB is reused after this */
+		usb_kill_urb(cmd->urb);
+		cmd->t_done = ktime_get();
+		ret = -ETIMEDOUT;
+	} else {
+		ret = cmd->status;
+	}
+
+	af9035_cmd_account(cmd, ret);
+	if (!ret && cmd->req.cmd != CMD_FW_DOWNLOAD)
+		af9035_rtt_update(cmd->state, ktime_to_us(ktime_sub(cmd->t_done,
+			cmd->t_submit)));
+
+	return ret;
+}
+
+/* wait reply for the command queued by af9035_cmd_submit(), reads are
+   sent once more when reply was lost */
+static int af9035_cmd_wait(struct af9035_cmd *cmd)
+{
+	unsigned long timeout = af9035_cmd_timeout(cmd);
+	struct af9035_req req;
+	u8 wbuf[AF9035_BUF_SIZE];
+	int ret;
+
+	ret = af9035_cmd_wait_once(cmd, timeout);
+	if (ret == -ETIMEDOUT)
+		af9035_recover(cmd->state);
+	else if (ret != -ECONNRESET)
+		return ret;
+
+	if (!af9035_cmd_idempotent(cmd->req.cmd))
+		return ret;
+
+	/* wbuf of the request may be gone, packet buffer still has it */
+	req = cmd->req;
+	memcpy(wbuf, &cmd->buf[4], req.wlen);
+	req.wbuf = wbuf;
+
+	deb_xfer("%s: retrying command:%02x\n", __func__, req.cmd);
+	cmd->t_queue = ktime_get();
+	ret = af9035_cmd_submit(cmd, &req);
 	if (ret)
-		goto error_unlock;
+		return ret;
 
-	/* no ack for those packets */
-	if (req->cmd == CMD_FW_DOWNLOAD)
-		goto exit_unlock;
+	timeout = min_t(unsigned long, 2 * timeout,
+		msecs_to_jiffies(AF9035_USB_TIMEOUT));
+	ret = af9035_cmd_wait_once(cmd, timeout);
+	if (ret == -ETIMEDOUT)
+		af9035_recover(cmd->state);
 
-	/* receive ack and data if read req */
-	msg_len = 3 + req->rlen + 2;  /* data len + status + seq + checksum */
-	ret = usb_bulk_msg(udev, usb_rcvbulkpipe(udev, 0x81), buf, msg_len,
-			   &act_len, AF9035_USB_TIMEOUT);
+	return ret;
+}
+
+/* wait all commands of the batch, first error is returned */
+static int af9035_batch_wait(struct af9035_batch *b)
+{
+	int ret = 0, i, tmp;
+
+	for (i = 0; i < b->num; i++) {
+		tmp = af9035_cmd_wait(b->cmd[i]);
+		af9035_cmd_put(b->cmd[i]);
+		if (tmp && !ret)
+			ret = tmp;
+	}
+	b->num = 0;
+
+	return ret;
+}
+
+/* wait the oldest command of the batch only, the rest keeps the bus busy */
+static int af9035_batch_wait_first(struct af9035_batch *b)
+{
+	int ret;
+
+	ret = af9035_cmd_wait(b->cmd[0]);
+	af9035_cmd_put(b->cmd[0]);
+	b->num--;
+	memmove(&b->cmd[0], &b->cmd[1], b->num * sizeof(b->cmd[0]));
+
+	return ret;
+}
+
+/* queue command back to back with the previous ones, when in-flight limit
+   is reached own oldest command is waited first so that the pool can't lock
+   up and the queue stays full */
+static int af9035_batch_add(struct af9035_batch *b, struct af9035_req *req)
+{
+	struct af9035_cmd *cmd;
+	ktime_t t = ktime_get();
+	int ret;
+
+	cmd = af9035_cmd_get(b->state, b->max);
+	if (cmd == NULL) {
+		if (b->num) {
+			ret = af9035_batch_wait_first(b);
+			if (ret)
+				return ret;
+		}
+
+		if (wait_event_interruptible(b->state->cmd_wait,
+			(cmd = af9035_cmd_get(b->state, b->max)) != NULL))
+			return -EAGAIN;
+	}
+
+	cmd->t_queue = t;
+	ret = af9035_cmd_submit(cmd, req);
 	if (ret) {
-		err("recv bulk message failed:%d", ret);
-		ret = -EIO;
-		goto error_unlock;
+		af9035_cmd_put(cmd);
+		return ret;
 	}
+	b->cmd[b->num++] = cmd;
+
+	return 0;
+}
 
-	deb_xfer("<<< ");
-	debug_dump(buf, act_len, deb_xfer);
+/* queue many commands back to back and wait all of them */
+static int af9035_rw_batch(struct af9035_state *state,
+	struct af9035_req *req, int num)
+{
+	struct af9035_batch b = { .state = state };
+	int ret = 0, i, tmp;
 
-	/* check status */
-	if (buf[2]) {
-		err("command:%02x failed:%d", req->cmd, buf[2]);
-		ret = -EIO;
-		goto error_unlock;
+	for (i = 0; i < num; i++) {
+		ret = af9035_batch_add(&b, &req[i]);
+		if (ret)
+			break;
 	}
 
-	/* read request, copy returned data to return buf */
-	if (req->rlen)
-		memcpy(req->rbuf, &buf[3], req->rlen);
-error_unlock:
+	tmp = af9035_batch_wait(&b);
+
+	return ret ? ret : tmp;
+}
+
+static struct af9035_state *af9035_state_find(struct usb_device *udev)
+{
+	struct af9035_state *state;
+
+	mutex_lock(&af9035_dev_list_mutex);
+	list_for_each_entry(state, &af9035_dev_list, list) {
+		if (state->udev == udev)
+			goto exit_unlock;
+	}
+	state = NULL;
 exit_unlock:
-	mutex_unlock(&af9035_usb_mutex);
+	mutex_unlock(&af9035_dev_list_mutex);
 
-	return ret;
+	return state;
 }
 
-static int af9035_write_regs_bis(struct usb_device *d, u8 mbox, u16 reg,
-u8 *val, u8 len)
+static bool af9035_reg_volatile(u8 mbox, u16 reg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(af9035_volatile_regs); i++) {
+		/* bits 4-6 are chip number, volatile on every chip */
+		if (af9035_volatile_regs[i].mbox == (mbox & ~0x70) &&
+			reg >= af9035_volatile_regs[i].first &&
+			reg <= af9035_volatile_regs[i].last)
+			return true;
+	}
+	return false;
+}
+
+/* shadow_lock must be held */
+static struct af9035_reg_val *af9035_shadow_find(struct af9035_state *state,
+	u8 mbox, u16 reg)
+{
+	int i;
+
+	for (i = 0; i < state->shadow_cnt; i++) {
+		if (state->shadow[i].mbox == mbox &&
+			state->shadow[i].reg == reg)
+			return &state->shadow[i];
+	}
+	return NULL;
+}
+
+static bool af9035_shadow_get(struct af9035_state *state, u8 mbox, u16 reg,
+	u8 *val)
+{
+	struct af9035_reg_val *r;
+
+	spin_lock(&state->shadow_lock);
+	r = af9035_shadow_find(state, mbox, reg);
+	if (r)
+		*val = r->val;
+	spin_unlock(&state->shadow_lock);
+
+	return r != NULL;
+}
+
+/* update shadow after registers are written to the chip */
+static void af9035_shadow_set(struct af9035_state *state, u8 mbox, u16 reg,
+	const u8 *val, int len)
+{
+	struct af9035_reg_val *r;
+	int i;
+
+	spin_lock(&state->shadow_lock);
+	for (i = 0; i < len; i++, reg++) {
+		if (af9035_reg_volatile(mbox, reg))
+			continue;
+
+		r = af9035_shadow_find(state, mbox, reg);
+		if (r == NULL) {
+			if (state->shadow_cnt < AF9035_SHADOW_SIZE) {
+				r = &state->shadow[state->shadow_cnt++];
+			} else {
+				r = &state->shadow[state->shadow_next++];
+				state->shadow_next %= AF9035_SHADOW_SIZE;
+			}
+			r->mbox = mbox;
+			r->reg = reg;
+		}
+		r->val = val[i];
+	}
+	spin_unlock(&state->shadow_lock);
+}
+
+static void af9035_shadow_invalidate(struct af9035_state *state)
+{
+	spin_lock(&state->shadow_lock);
+	state->shadow_cnt = 0;
+	state->shadow_next = 0;
+	spin_unlock(&state->shadow_lock);
+}
+
+static int af9035_ctrl_msg(struct af9035_state *state, struct af9035_req *req)
+{
+	return af9035_rw_batch(state, req, 1);
+}
+
+static inline struct af9035_state *af9035_d_to_state(struct dvb_usb_device *d)
+{
+	return *(struct af9035_state **) d->priv;
+}
+
+static const char * const af9035_phase_name[AF9035_PHASE_NUM] = {
+	[AF9035_PHASE_PROBE] = "probe",
+	[AF9035_PHASE_READ_CONFIG] = "read_config",
+	[AF9035_PHASE_AUX_INIT] = "aux_init",
+	[AF9035_PHASE_FW_LOAD] = "firmware",
+	[AF9035_PHASE_REG_WAIT] = "register_wait",
+	[AF9035_PHASE_IDENTIFY] = "identify_state",
+	[AF9035_PHASE_FE_ATTACH] = "frontend_attach0",
+	[AF9035_PHASE_FE_ATTACH + 1] = "frontend_attach1",
+	[AF9035_PHASE_TUNER_ATTACH] = "tuner_attach0",
+	[AF9035_PHASE_TUNER_ATTACH + 1] = "tuner_attach1",
+	[AF9035_PHASE_INIT] = "init",
+	[AF9035_PHASE_INIT_ENDPOINT] = "init_endpoint",
+};
+
+/* boot timeline, monotonic time of phase start and end */
+static void af9035_phase_start(struct af9035_state *state, int phase)
+{
+	state->phase[phase].start = ktime_get();
+	state->phase[phase].end = ktime_set(0, 0);
+}
+
+static void af9035_phase_end(struct af9035_state *state, int phase)
+{
+	state->phase[phase].end = ktime_get();
+}
+
+/* phase duration in ms, 0 when it did not run */
+static u32 af9035_phase_ms(struct af9035_state *state, int phase)
+{
+	if (!ktime_to_ns(state->phase[phase].end))
+		return 0;
+
+	return div_u64(ktime_to_us(ktime_sub(state->phase[phase].end,
+		state->phase[phase].start)), 1000);
+}
+
+static void af9035_phase_log(struct af9035_state *state)
+{
+	info("%s: ready in %u ms: config %u aux %u fw %u wait %u identify %u "
+		"fe %u/%u tuner %u/%u init %u (endpoint %u)",
+		dev_name(&state->intf->dev),
+		af9035_phase_ms(state, AF9035_PHASE_PROBE),
+		af9035_phase_ms(state, AF9035_PHASE_READ_CONFIG),
+		af9035_phase_ms(state, AF9035_PHASE_AUX_INIT),
+		af9035_phase_ms(state, AF9035_PHASE_FW_LOAD),
+		af9035_phase_ms(state, AF9035_PHASE_REG_WAIT),
+		af9035_phase_ms(state, AF9035_PHASE_IDENTIFY),
+		af9035_phase_ms(state, AF9035_PHASE_FE_ATTACH),
+		af9035_phase_ms(state, AF9035_PHASE_FE_ATTACH + 1),
+		af9035_phase_ms(state, AF9035_PHASE_TUNER_ATTACH),
+		af9035_phase_ms(state, AF9035_PHASE_TUNER_ATTACH + 1),
+		af9035_phase_ms(state, AF9035_PHASE_INIT),
+		af9035_phase_ms(state, AF9035_PHASE_INIT_ENDPOINT));
+}
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *af9035_debugfs_root;
+
+static int af9035_stats_show(struct seq_file *s, void *unused)
 {
-	u8 wbuf[6+len];
-	struct af9035_req req = {CMD_REG_DEMOD_WRITE, mbox, sizeof(wbuf), wbuf,
-		0, NULL};
+	struct af9035_state *state = s->private;
+	struct af9035_cmd_stat stat;
+	int i, j;
+
+	seq_puts(s, "# cmd count errors avg_us max_us "
+		"histogram (<64us, doubling, last >=65ms)\n");
+	for (i = 0; i < AF9035_STAT_CMDS; i++) {
+		spin_lock_irq(&state->cmd_lock);
+		stat = state->stat[i];
+		spin_unlock_irq(&state->cmd_lock);
+
+		if (!stat.count)
+			continue;
+
+		seq_printf(s, "%02x%s %u %u %llu %u", i,
+			i == AF9035_STAT_CMDS - 1 ? "+" : "", stat.count,
+			stat.errors, div_u64(stat.total_us, stat.count),
+			stat.max_us);
+		for (j = 0; j < AF9035_STAT_BUCKETS; j++)
+			seq_printf(s, " %u", stat.hist[j]);
+		seq_puts(s, "\n");
+	}
+
+	return 0;
+}
+
+static int af9035_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, af9035_stats_show, inode->i_private);
+}
+
+/* any write clears the statistics */
+static ssize_t af9035_stats_write(struct file *file, const char __user *buf,
+	size_t count, loff_t *ppos)
+{
+	struct af9035_state *state =
+		((struct seq_file *) file->private_data)->private;
+
+	spin_lock_irq(&state->cmd_lock);
+	memset(state->stat, 0, sizeof(state->stat));
+	spin_unlock_irq(&state->cmd_lock);
+
+	return count;
+}
+
+static const struct file_operations af9035_stats_fops = {
+	.owner = THIS_MODULE,
+	.open = af9035_stats_open,
+	.read = seq_read,
+	.write = af9035_stats_write,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+/* phase times in us from probe start */
+static int af9035_timeline_show(struct seq_file *s, void *unused)
+{
+	struct af9035_state *state = s->private;
+	ktime_t t0 = state->phase[AF9035_PHASE_PROBE].start;
+	struct af9035_phase_time *t;
+	int i;
+
+	seq_puts(s, "# phase start_us end_us duration_us\n");
+	for (i = 0; i < AF9035_PHASE_NUM; i++) {
+		t = &state->phase[i];
+		if (!ktime_to_ns(t->start))
+			continue;
+
+		if (!ktime_to_ns(t->end)) {
+			seq_printf(s, "%s %lld - -\n", af9035_phase_name[i],
+				ktime_to_us(ktime_sub(t->start, t0)));
+			continue;
+		}
+
+		seq_printf(s, "%s %lld %lld %lld\n", af9035_phase_name[i],
+			ktime_to_us(ktime_sub(t->start, t0)),
+			ktime_to_us(ktime_sub(t->end, t0)),
+			ktime_to_us(ktime_sub(t->end, t->start)));
+	}
+
+	return 0;
+}
+
+static int af9035_timeline_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, af9035_timeline_show, inode->i_private);
+}
+
+static const struct file_operations af9035_timeline_fops = {
+	.owner = THIS_MODULE,
+	.open = af9035_timeline_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static void af9035_debugfs_init(struct af9035_state *state)
+{
+	if (IS_ERR_OR_NULL(af9035_debugfs_root))
+		return;
+
+	state->debugfs = debugfs_create_dir(dev_name(&state->intf->dev),
+		af9035_debugfs_root);
+	if (IS_ERR_OR_NULL(state->debugfs)) {
+		state->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("cmd_stats", 0644, state->debugfs, state,
+		&af9035_stats_fops);
+	debugfs_create_file("timeline", 0444, state->debugfs, state,
+		&af9035_timeline_fops);
+}
+
+static void af9035_debugfs_exit(struct af9035_state *state)
+{
+	debugfs_remove_recursive(state->debugfs);
+}
+#else
+static inline void af9035_debugfs_init(struct af9035_state *state) {}
+static inline void af9035_debugfs_exit(struct af9035_state *state) {}
+#endif
+
+/* parsed firmware image, shared by all devices */
+static DEFINE_MUTEX(af9035_fw_mutex);
+static struct af9035_fw *af9035_fw_cache;
+
+/* af9035_fw_mutex must be held */
+static void af9035_fw_release(struct kref *kref)
+{
+	struct af9035_fw *f = container_of(kref, struct af9035_fw, kref);
+
+	if (af9035_fw_cache == f)
+		af9035_fw_cache = NULL;
+	release_firmware(f->fw);
+	kfree(f);
+}
+
+static void af9035_fw_put(struct af9035_fw *f)
+{
+	if (!f)
+		return;
+
+	mutex_lock(&af9035_fw_mutex);
+	kref_put(&f->kref, af9035_fw_release);
+	mutex_unlock(&af9035_fw_mutex);
+}
+
+static void af9035_cmd_pool_free(struct af9035_state *state)
+{
+	int i;
+
+	for (i = 0; i < AF9035_CMD_INFLIGHT_MAX; i++) {
+		usb_kill_urb(state->cmd_pool[i].urb);
+		usb_free_urb(state->cmd_pool[i].urb);
+		kfree(state->cmd_pool[i].buf);
+	}
+}
+
+static struct af9035_state *af9035_state_create(struct usb_interface *intf)
+{
+	struct af9035_state *state;
+	struct af9035_cmd *cmd;
+	int i;
+
+	state = kzalloc(sizeof(struct af9035_state), GFP_KERNEL);
+	if (state == NULL)
+		return NULL;
+
+	state->udev = interface_to_usbdev(intf);
+	state->intf = intf;
+	memcpy(state->af9033_config, af9035_af9033_config,
+		sizeof(state->af9033_config));
+	spin_lock_init(&state->cmd_lock);
+	spin_lock_init(&state->shadow_lock);
+	mutex_init(&state->recover_lock);
+	for (i = 0; i < AF9035_I2C_BUS_MAX; i++)
+		mutex_init(&state->i2c_lock[i]);
+	INIT_LIST_HEAD(&state->cmd_pending);
+	init_waitqueue_head(&state->cmd_wait);
+
+	state->rx_buf = kmalloc(AF9035_BUF_SIZE + 1, GFP_KERNEL);
+	state->rx_urb = usb_alloc_urb(0, GFP_KERNEL);
+	if (!state->rx_buf || !state->rx_urb)
+		goto error;
+
+	/* command buffers must not live on stack, they are DMA'd */
+	for (i = 0; i < AF9035_CMD_INFLIGHT_MAX; i++) {
+		cmd = &state->cmd_pool[i];
+		cmd->state = state;
+		INIT_LIST_HEAD(&cmd->list);
+		cmd->buf = kmalloc(AF9035_BUF_SIZE + 1, GFP_KERNEL);
+		cmd->urb = usb_alloc_urb(0, GFP_KERNEL);
+		if (!cmd->buf || !cmd->urb)
+			goto error;
+	}
+
+	usb_fill_bulk_urb(state->rx_urb, state->udev,
+		usb_rcvbulkpipe(state->udev, 0x81), state->rx_buf,
+		AF9035_BUF_SIZE + 1, af9035_rx_complete, state);
+
+	init_completion(&state->ready);
+
+	mutex_lock(&af9035_dev_list_mutex);
+	state->probe_seq = af9035_probe_seq++;
+	list_add_tail(&state->list, &af9035_dev_list);
+	mutex_unlock(&af9035_dev_list_mutex);
+
+	af9035_debugfs_init(state);
+
+	return state;
+error:
+	af9035_cmd_pool_free(state);
+	usb_free_urb(state->rx_urb);
+	kfree(state->rx_buf);
+	kfree(state);
+	return NULL;
+}
+
+static void af9035_state_release(struct af9035_state *state)
+{
+	af9035_debugfs_exit(state);
+
+	mutex_lock(&af9035_dev_list_mutex);
+	list_del(&state->list);
+	mutex_unlock(&af9035_dev_list_mutex);
+
+	usb_kill_urb(state->rx_urb);
+	af9035_cmd_pool_free(state);
+	usb_free_urb(state->rx_urb);
+	kfree(state->rx_buf);
+	af9035_fw_put(state->fw);
+	kfree(state);
+}
+
+/* fill demod register command header for req->cmd, reads use short command
+   when firmware has it, returns header length */
+static int af9035_demod_hdr(struct af9035_state *state,
+	struct af9035_req *req, u16 reg, u8 len)
+{
+	u8 *wbuf = req->wbuf;
+
 	wbuf[0] = len;
+	if (state->short_cmd && req->cmd == CMD_REG_DEMOD_READ) {
+		req->cmd = CMD_SHORT_REG_DEMOD_READ;
+		wbuf[1] = reg >> 8;
+		wbuf[2] = reg & 0xff;
+		return 3;
+	}
+
 	wbuf[1] = 2;
 	wbuf[2] = 0;
 	wbuf[3] = 0;
 	wbuf[4] = reg >> 8;
 	wbuf[5] = reg & 0xff;
-	memcpy(&wbuf[6], val, len);
-	return af9035_rw_udev(d, &req);
+	return 6;
+}
+
+static int af9035_write_regs_bis(struct af9035_state *state, u8 mbox,
+	u16 reg, u8 *val, u8 len)
+{
+	u8 wbuf[6 + AF9035_DEMOD_WR_MAX];
+	struct af9035_req req = {CMD_REG_DEMOD_WRITE, mbox, 0, wbuf, 0, NULL};
+	int ret;
+
+	if (len > AF9035_DEMOD_WR_MAX) {
+		err("too much data len:%d", len);
+		return -EINVAL;
+	}
+
+	req.wlen = af9035_demod_hdr(state, &req, reg, len);
+	memcpy(&wbuf[req.wlen], val, len);
+	req.wlen += len;
+	ret = af9035_ctrl_msg(state, &req);
+	if (!ret)
+		af9035_shadow_set(state, mbox, reg, val, len);
+	return ret;
 }
 
 static int af9035_write_regs(struct dvb_usb_device *d, u8 mbox, u16 reg,
 u8 *val, u8 len)
 {
-	return af9035_write_regs_bis(d->udev, mbox, reg, val, len);
+	return af9035_write_regs_bis(af9035_d_to_state(d), mbox, reg, val, len);
 }
 
-static int af9035_read_regs_bis(struct usb_device *d, u8 mbox, u16 reg, u8 *val,
-	u8 len)
+static int af9035_read_regs_bis(struct af9035_state *state, u8 mbox, u16 reg,
+	u8 *val, u8 len)
 {
-	u8 wbuf[] = {len, 2, 0, 0, reg >> 8, reg & 0xff};
-	struct af9035_req req = {CMD_REG_DEMOD_READ, mbox, sizeof(wbuf), wbuf,
-		len, val};
-	return af9035_rw_udev(d, &req);
+	u8 wbuf[6];
+	struct af9035_req req = {CMD_REG_DEMOD_READ, mbox, 0, wbuf, len, val};
+
+	req.wlen = af9035_demod_hdr(state, &req, reg, len);
+	return af9035_ctrl_msg(state, &req);
 }
 
 static int af9035_read_regs(struct dvb_usb_device *d, u8 mbox, u16 reg, u8 *val,
 	u8 len)
 {
-	return af9035_read_regs_bis(d->udev, mbox, reg, val, len);
+	return af9035_read_regs_bis(af9035_d_to_state(d), mbox, reg, val, len);
 }
 
-static int af9035_write_reg_bis(struct usb_device *d, u8 mbox, u16 reg, u8 val)
+static int af9035_write_reg_bis(struct af9035_state *state, u8 mbox, u16 reg,
+	u8 val)
 {
-	return af9035_write_regs_bis(d, mbox, reg, &val, 1);
+	return af9035_write_regs_bis(state, mbox, reg, &val, 1);
 }
 
 static int af9035_write_reg(struct dvb_usb_device *d, u8 mbox, u16 reg, u8 val)
 {
-	return af9035_write_regs_bis(d->udev, mbox, reg, &val, 1);
+	return af9035_write_regs_bis(af9035_d_to_state(d), mbox, reg, &val, 1);
 }
 
-static int af9035_read_reg_bis(struct usb_device *d, u8 mbox, u16 reg, u8 *val)
+static int af9035_read_reg_bis(struct af9035_state *state, u8 mbox, u16 reg,
+	u8 *val)
 {
-	return af9035_read_regs_bis(d, mbox, reg, val, 1);
+	return af9035_read_regs_bis(state, mbox, reg, val, 1);
 }
 
-static int af9035_write_reg_bits_bis(struct usb_device *d, u8 mbox, u16 reg,
-	u8 pos, u8 len, u8 val)
+static int af9035_write_reg_bits_bis(struct af9035_state *state, u8 mbox,
+	u16 reg, u8 pos, u8 len, u8 val)
 {
 	int ret;
 	u8 tmp, mask;
 
-	ret = af9035_read_reg_bis(d, mbox, reg, &tmp);
-	if (ret)
-		return ret;
+	if (!af9035_shadow_get(state, mbox, reg, &tmp)) {
+		ret = af9035_read_reg_bis(state, mbox, reg, &tmp);
+		if (ret)
+			return ret;
+	}
 
 	mask = regmask[len - 1] << pos;
 	tmp = (tmp & ~mask) | ((val << pos) & mask);
 
-	return af9035_write_reg_bis(d, mbox, reg, tmp);
+	return af9035_write_reg_bis(state, mbox, reg, tmp);
+}
+
+static int af9035_write_reg_bits(struct dvb_usb_device *d, u8 mbox, u16 reg,
+	u8 pos, u8 len, u8 val)
+{
+	return af9035_write_reg_bits_bis(af9035_d_to_state(d), mbox, reg, pos,
+		len, val);
+}
+
+static int af9035_read_reg_bits_bis(struct af9035_state *state, u8 mbox,
+	u16 reg, u8 pos, u8 len, u8 *val)
+{
+	int ret;
+	u8 tmp;
+
+	ret = af9035_read_reg_bis(state, mbox, reg, &tmp);
+	if (ret)
+		return ret;
+	*val = (tmp >> pos) & regmask[len - 1];
+	return 0;
+}
+
+/* one scatter command per mbox run when the firmware has them, otherwise one
+   pipelined command per register */
+static int af9035_rw_reg_list_once(struct af9035_state *state,
+	struct af9035_reg_val *tab, int num, bool write)
+{
+	struct af9035_batch b = { .state = state };
+	struct af9035_req req = {0, LINK, 0, NULL, 0, NULL};
+	u8 wbuf[AF9035_BUF_SIZE - 6], rbuf[AF9035_SCATTER_RD_MAX];
+	u8 *p;
+	int ret = 0, i, j, n, max, tmp;
+
+	/* wbuf is copied to the command buffer on submit, reuse it */
+	req.wbuf = wbuf;
+	if (state->scatter) {
+		max = write ? AF9035_SCATTER_WR_MAX : AF9035_SCATTER_RD_MAX;
+		for (i = 0; i < num; i += n) {
+			for (n = 1; i + n < num && n < max; n++) {
+				if (tab[i + n].mbox != tab[i].mbox)
+					break;
+			}
+
+			req.cmd = write ? CMD_SCATTER_WRITE : CMD_SCATTER_READ;
+			req.mbox = tab[i].mbox;
+			p = wbuf;
+			*p++ = n;
+			for (j = i; j < i + n; j++) {
+				*p++ = tab[j].reg >> 8;
+				*p++ = tab[j].reg & 0xff;
+				if (write)
+					*p++ = tab[j].val;
+			}
+			req.wlen = p - wbuf;
+			if (!write) {
+				req.rlen = n;
+				req.rbuf = rbuf;
+			}
+
+			ret = af9035_batch_add(&b, &req);
+			if (ret)
+				break;
+
+			/* reply lands to rbuf, it is not reused before read */
+			if (!write) {
+				ret = af9035_batch_wait(&b);
+				if (ret)
+					break;
+				for (j = 0; j < n; j++)
+					tab[i + j].val = rbuf[j];
+			}
+		}
+	} else {
+		for (i = 0; i < num; i++) {
+			req.cmd = write ? CMD_REG_DEMOD_WRITE :
+				CMD_REG_DEMOD_READ;
+			req.mbox = tab[i].mbox;
+			req.wlen = af9035_demod_hdr(state, &req, tab[i].reg, 1);
+			if (write) {
+				wbuf[req.wlen++] = tab[i].val;
+			} else {
+				req.rlen = 1;
+				req.rbuf = &tab[i].val;
+			}
+
+			ret = af9035_batch_add(&b, &req);
+			if (ret)
+				break;
+		}
+	}
+
+	tmp = af9035_batch_wait(&b);
+	if (!ret)
+		ret = tmp;
+
+	return ret;
+}
+
+/* read or write a list of single registers, written values are shadowed */
+static int af9035_rw_reg_list(struct af9035_state *state,
+	struct af9035_reg_val *tab, int num, bool write)
+{
+	int ret, i;
+
+	if (num == 0)
+		return 0;
+
+	ret = af9035_rw_reg_list_once(state, tab, num, write);
+	if (ret && ret != -EIO && ret != -ENODEV && ret != -ESHUTDOWN) {
+		/* transfer failed, list is sent again as it was, values
+		   written already are the same */
+		deb_info("%s: retrying list failed:%d\n", __func__, ret);
+		ret = af9035_rw_reg_list_once(state, tab, num, write);
+	}
+
+	if (ret == -EIO && state->scatter) {
+		/* firmware does not know scatter commands, it did not apply
+		   any of them */
+		warn("scatter commands refused, disabling them");
+		state->scatter = 0;
+		ret = af9035_rw_reg_list_once(state, tab, num, write);
+	}
+	if (ret)
+		return ret;
+
+	if (write) {
+		for (i = 0; i < num; i++)
+			af9035_shadow_set(state, tab[i].mbox, tab[i].reg,
+				&tab[i].val, 1);
+	}
+
+	return 0;
+}
+
+/* scratch register for checking scatter writes, set to AF9035_SCRATCH_INIT
+   when init is done and lost when the chip is reset */
+#define AF9035_SCRATCH_REG p_reg_link_ofsm_dummy_23_16
+#define AF9035_SCRATCH_INIT 0x5a
+
+/* write pattern to scratch register with a scatter command, read it back
+   with a plain one and restore it, scatter must be on, returns 1 when it
+   read back what was written */
+static int af9035_scratch_check(struct af9035_state *state)
+{
+	struct af9035_reg_val tab = {LINK, AF9035_SCRATCH_REG, 0};
+	u8 orig, val;
+	bool ok = false;
+	int ret;
+
+	state->scatter = 0;
+	ret = af9035_read_reg_bis(state, LINK, AF9035_SCRATCH_REG, &orig);
+	if (ret)
+		goto exit;
+
+	tab.val = orig ^ 0xa5;
+	state->scatter = 1;
+	ret = af9035_rw_reg_list(state, &tab, 1, true);
+	/* scatter is cleared when firmware rejected it and write was redone */
+	ok = !ret && state->scatter;
+	state->scatter = 0;
+	if (ret == -EIO)
+		ret = 0;
+	if (ret)
+		goto exit;
+
+	ret = af9035_read_reg_bis(state, LINK, AF9035_SCRATCH_REG, &val);
+	if (ret)
+		goto exit;
+	ok = ok && val == tab.val;
+
+	ret = af9035_write_reg_bis(state, LINK, AF9035_SCRATCH_REG, orig);
+exit:
+	state->scatter = 1;
+	deb_info("%s: ok:%d ret:%d\n", __func__, ok, ret);
+
+	return ret ? ret : ok;
+}
+
+/* scatter commands are used only after they read back what plain reads do */
+static int af9035_scatter_probe(struct af9035_state *state)
+{
+	int ret;
+	u8 ver[4];
+	struct af9035_reg_val tab[] = {
+		{LINK, 0x83ec, 0},
+		{LINK, 0x83e9, 0},
+	};
+
+	state->scatter = 0;
+	if (!af9035_scatter)
+		return 0;
+
+	/* LINK firmware version */
+	ret = af9035_read_regs_bis(state, LINK, 0x83e9, ver, sizeof(ver));
+	if (ret)
+		return ret;
+
+	state->scatter = 1;
+	ret = af9035_rw_reg_list(state, tab, ARRAY_SIZE(tab), false);
+	if (ret)
+		return ret;
+
+	if (state->scatter && (tab[0].val != ver[3] || tab[1].val != ver[0])) {
+		warn("scatter read mismatch, disabling scatter commands");
+		state->scatter = 0;
+	}
+
+	/* firmware may take scatter reads but not writes, check those too */
+	if (state->scatter) {
+		ret = af9035_scratch_check(state);
+		if (ret < 0)
+			return ret;
+		if (!ret) {
+			warn("scatter write mismatch, disabling scatter commands");
+			state->scatter = 0;
+		}
+	}
+	deb_info("%s: scatter:%d\n", __func__, state->scatter);
+
+	return 0;
+}
+
+/* wait I2C writes queued by the bridge and shadow them, failed tells the
+   transfer was aborted and some of the writes were not acked */
+static int af9035_i2c_wait(struct af9035_i2c_batch *ib, bool failed)
+{
+	struct af9035_state *state = ib->b.state;
+	int ret, i;
+
+	ret = af9035_batch_wait(&ib->b);
+	if (ret || failed) {
+		/* failed writes may still have landed */
+		if (ret || ib->wr_num)
+			af9035_shadow_invalidate(state);
+	} else {
+		for (i = 0; i < ib->wr_num; i++)
+			af9035_shadow_set(state, ib->wr[i].mbox,
+				ib->wr[i].reg, ib->wr[i].val, ib->wr[i].len);
+	}
+	ib->wr_num = 0;
+
+	return ret;
+}
+
+static inline const struct af9035_i2c_route *af9035_i2c_route(
+	struct af9035_state *state, u16 addr)
+{
+	if (addr >= ARRAY_SIZE(state->i2c_route) ||
+		state->i2c_route[addr].type == AF9035_I2C_NONE)
+		return NULL;
+	return &state->i2c_route[addr];
+}
+
+/* collapse a run of single register demod accesses to one register list,
+   returns count of messages handled */
+static int af9035_i2c_reg_list(struct af9035_state *state,
+	const struct af9035_i2c_route *r, struct i2c_msg *msg, int num)
+{
+	struct af9035_reg_val tab[AF9035_SCATTER_RD_MAX];
+	u16 addr = msg[0].addr;
+	bool read;
+	int ret, i, j, n;
+
+	read = num > 1 && (msg[1].flags & I2C_M_RD);
+	for (i = 0, n = 0; n < ARRAY_SIZE(tab); n++) {
+		if (i >= num || msg[i].addr != addr ||
+			(msg[i].flags & I2C_M_RD))
+			break;
+		if (read) {
+			if (msg[i].len != 3 || i + 1 >= num ||
+				msg[i + 1].addr != addr ||
+				!(msg[i + 1].flags & I2C_M_RD) ||
+				msg[i + 1].len != 1)
+				break;
+		} else {
+			if (msg[i].len != 4 ||
+				(i + 1 < num && (msg[i + 1].flags & I2C_M_RD)))
+				break;
+		}
+		tab[n].mbox = msg[i].buf[0] + r->mbox;
+		tab[n].reg = msg[i].buf[1] << 8 | msg[i].buf[2];
+		tab[n].val = read ? 0 : msg[i].buf[3];
+		i += read ? 2 : 1;
+	}
+	if (n < 2)
+		return 0;
+
+	ret = af9035_rw_reg_list(state, tab, n, !read);
+	if (ret)
+		return ret;
+
+	if (read) {
+		for (j = 0; j < n; j++)
+			msg[2 * j + 1].buf[0] = tab[j].val;
+	}
+
+	/* messages consumed, two per register for reads */
+	return i;
+}
+
+/* tuner read behind demod I2C bridge, register address of up to two bytes
+   goes to command header and data is read straight to message buffer */
+static int af9035_i2c_tuner_read(struct af9035_batch *b, u8 mbox, u8 addr,
+	struct i2c_msg *wr, struct i2c_msg *rd)
+{
+	u8 wbuf[5];
+	struct af9035_req req = {CMD_REG_TUNER_READ, mbox, sizeof(wbuf), wbuf,
+		rd->len, rd->buf};
+	u8 width = wr ? wr->len : 0;
+
+	if (width > 2 || !rd->len || rd->len > AF9035_TUNER_RD_MAX)
+		return -EOPNOTSUPP;
+
+	wbuf[0] = rd->len; /* read len */
+	wbuf[1] = addr; /* tuner i2c addr */
+	wbuf[2] = width; /* reg width */
+	wbuf[3] = width == 2 ? wr->buf[0] : 0x00; /* reg MSB */
+	wbuf[4] = width ? wr->buf[width - 1] : 0x00; /* reg LSB */
+
+	return af9035_batch_add(b, &req);
+}
+
+/* messages without start continue the write and are packed to the same
+   command, returns messages used */
+static int af9035_i2c_tuner_write(struct af9035_batch *b, u8 mbox, u8 addr,
+	struct i2c_msg *msg, int num)
+{
+	u8 wbuf[AF9035_BUF_SIZE];
+	struct af9035_req req = {CMD_REG_TUNER_WRITE, mbox, 4, wbuf, 0, NULL};
+	int ret, i;
+
+	for (i = 0; i < num; i++) {
+		if (i && !(msg[i].flags & I2C_M_NOSTART))
+			break;
+		if ((msg[i].flags & I2C_M_RD) ||
+			req.wlen - 4 + msg[i].len > AF9035_TUNER_WR_MAX)
+			return -EOPNOTSUPP;
+		memcpy(&wbuf[req.wlen], msg[i].buf, msg[i].len);
+		req.wlen += msg[i].len;
+	}
+	if (req.wlen == 4)
+		return -EOPNOTSUPP;
+
+	wbuf[0] = req.wlen - 5; /* write len */
+	wbuf[1] = addr; /* tuner i2c addr */
+	wbuf[2] = 0x01; /* reg width */
+	wbuf[3] = 0x00; /* reg MSB, reg LSB and data follow */
+
+	ret = af9035_batch_add(b, &req);
+	return ret ? ret : i;
+}
+
+/* queue tuner message, or write and read pair, returns messages used */
+static int af9035_i2c_tuner_msg(struct af9035_batch *b,
+	const struct af9035_i2c_route *r, struct i2c_msg *msg, int num)
+{
+	u8 mbox = LINK + r->mbox, addr = r->addr;
+	int ret;
+
+	/* read from current register */
+	if (msg[0].flags & I2C_M_RD) {
+		ret = af9035_i2c_tuner_read(b, mbox, addr, NULL, &msg[0]);
+		return ret ? ret : 1;
+	}
+
+	if (num > 1 && (msg[1].flags & I2C_M_RD) &&
+		msg[1].addr == msg[0].addr) {
+		ret = af9035_i2c_tuner_read(b, mbox, addr, &msg[0], &msg[1]);
+		return ret ? ret : 2;
+	}
+
+	return af9035_i2c_tuner_write(b, mbox, addr, msg, num);
+}
+
+/* raw I2C read, from current register of the tuner */
+static int af9035_i2c_generic_read(struct af9035_batch *b, u8 mbox, u8 addr,
+	struct i2c_msg *rd)
+{
+	u8 wbuf[3];
+	struct af9035_req req = {CMD_GENERIC_READ, mbox, sizeof(wbuf), wbuf,
+		rd->len, rd->buf};
+
+	if (!rd->len || rd->len > AF9035_GENERIC_RD_MAX)
+		return -EOPNOTSUPP;
+
+	wbuf[0] = rd->len; /* read len */
+	wbuf[1] = AF9035_GENERIC_I2C_BUS;
+	wbuf[2] = addr; /* tuner i2c addr */
+
+	return af9035_batch_add(b, &req);
+}
+
+/* raw I2C write, messages without start are packed like for tuner command,
+   returns messages used */
+static int af9035_i2c_generic_write(struct af9035_batch *b, u8 mbox,
+	u8 addr, struct i2c_msg *msg, int num)
+{
+	u8 wbuf[AF9035_BUF_SIZE];
+	struct af9035_req req = {CMD_GENERIC_WRITE, mbox, 3, wbuf, 0, NULL};
+	int ret, i;
+
+	for (i = 0; i < num; i++) {
+		if (i && !(msg[i].flags & I2C_M_NOSTART))
+			break;
+		if ((msg[i].flags & I2C_M_RD) ||
+			req.wlen - 3 + msg[i].len > AF9035_GENERIC_WR_MAX)
+			return -EOPNOTSUPP;
+		memcpy(&wbuf[req.wlen], msg[i].buf, msg[i].len);
+		req.wlen += msg[i].len;
+	}
+	if (req.wlen == 3)
+		return -EOPNOTSUPP;
+
+	wbuf[0] = req.wlen - 3; /* write len */
+	wbuf[1] = AF9035_GENERIC_I2C_BUS;
+	wbuf[2] = addr; /* tuner i2c addr */
+
+	ret = af9035_batch_add(b, &req);
+	return ret ? ret : i;
+}
+
+/* queue tuner message as generic command, register address of a write and
+   read pair is an ordinary write, returns messages used */
+static int af9035_i2c_generic_msg(struct af9035_batch *b,
+	const struct af9035_i2c_route *r, struct i2c_msg *msg, int num)
+{
+	int ret;
+
+	if (msg[0].flags & I2C_M_RD) {
+		ret = af9035_i2c_generic_read(b, LINK + r->mbox, r->addr,
+			&msg[0]);
+		return ret ? ret : 1;
+	}
+
+	return af9035_i2c_generic_write(b, LINK + r->mbox, r->addr, msg, num);
+}
+
+static void af9035_i2c_cost_add(unsigned int *cost, unsigned int n, bool ok)
+{
+	if (!ok || *cost == UINT_MAX)
+		*cost = UINT_MAX;
+	else
+		*cost += n;
+}
+
+/* commands tuner messages of a transfer take as tuner and generic commands,
+   UINT_MAX when they cannot be sent that way */
+static void af9035_i2c_cost(struct af9035_state *state, struct i2c_msg *msg,
+	int num, unsigned int *tuner, unsigned int *generic)
+{
+	const struct af9035_i2c_route *r;
+	unsigned int len;
+	int i = 0, n;
+
+	*tuner = 0;
+	*generic = 0;
+	while (i < num) {
+		r = af9035_i2c_route(state, msg[i].addr);
+		if (!r || r->type != AF9035_I2C_TUNER) {
+			i++;
+			continue;
+		}
+		if (!r->generic)
+			*generic = UINT_MAX;
+
+		if (msg[i].flags & I2C_M_RD) {
+			af9035_i2c_cost_add(tuner, 1,
+				msg[i].len <= AF9035_TUNER_RD_MAX);
+			af9035_i2c_cost_add(generic, 1,
+				msg[i].len <= AF9035_GENERIC_RD_MAX);
+			i++;
+			continue;
+		}
+
+		/* write and its continuations */
+		len = msg[i].len;
+		for (n = 1; i + n < num; n++) {
+			if (!(msg[i + n].flags & I2C_M_NOSTART) ||
+				(msg[i + n].flags & I2C_M_RD))
+				break;
+			len += msg[i + n].len;
+		}
+
+		/* tuner command takes register address with the read */
+		if (n == 1 && i + 1 < num && (msg[i + 1].flags & I2C_M_RD) &&
+			msg[i + 1].addr == msg[i].addr) {
+			af9035_i2c_cost_add(tuner, 1, len <= 2 &&
+				msg[i + 1].len <= AF9035_TUNER_RD_MAX);
+			af9035_i2c_cost_add(generic, 2, len &&
+				len <= AF9035_GENERIC_WR_MAX &&
+				msg[i + 1].len <= AF9035_GENERIC_RD_MAX);
+			i += 2;
+			continue;
+		}
+
+		af9035_i2c_cost_add(tuner, 1, len && len <= AF9035_TUNER_WR_MAX);
+		af9035_i2c_cost_add(generic, 1,
+			len && len <= AF9035_GENERIC_WR_MAX);
+		i += n;
+	}
 }
 
-static int af9035_write_reg_bits(struct dvb_usb_device *d, u8 mbox, u16 reg,
-	u8 pos, u8 len, u8 val)
+/* route address used by drivers to demod or tuner behind demod of bus */
+static int af9035_i2c_route_add(struct af9035_state *state, u16 addr,
+	u8 type, u8 bus, u8 real_addr)
 {
-	return af9035_write_reg_bits_bis(d->udev, mbox, reg, pos, len, val);
-}
+	struct af9035_i2c_route *r;
 
-static int af9035_read_reg_bits_bis(struct usb_device *d, u8 mbox, u16 reg,
-	u8 pos, u8 len, u8 *val)
-{
-	int ret;
-	u8 tmp;
+	if (addr >= ARRAY_SIZE(state->i2c_route) || bus >= AF9035_I2C_BUS_MAX)
+		return -EINVAL;
+
+	r = &state->i2c_route[addr];
+	if (r->type != AF9035_I2C_NONE && (r->type != type || r->bus != bus)) {
+		err("I2C address:%02x routed already", addr);
+		return -EBUSY;
+	}
+
+	r->type = type;
+	r->mbox = bus << 4;
+	r->addr = real_addr;
+	r->bus = bus;
+	deb_info("%s: addr:%02x type:%d bus:%d real:%02x\n", __func__, addr,
+		type, bus, real_addr);
 
-	ret = af9035_read_reg_bis(d, mbox, reg, &tmp);
-	if (ret)
-		return ret;
-	*val = (tmp >> pos) & regmask[len - 1];
 	return 0;
 }
 
@@ -237,88 +1642,151 @@ static int af9035_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg msg[],
 	int num)
 {
 	struct dvb_usb_device *d = i2c_get_adapdata(adap);
-	int ret = 0, i = 0;
+	struct af9035_state *state = af9035_d_to_state(d);
+	struct af9035_i2c_batch b = { .b.state = state };
+	const struct af9035_i2c_route *r;
+	struct mutex *lock;
+	unsigned int tuner, generic;
+	int ret = 0, i = 0, tmp;
 	u16 reg;
-	u8 mbox;
+	u8 mbox, bus;
+
+	/* adapter may be used before the state is bound, see power_ctrl */
+	if (!state)
+		return -ENODEV;
+
+	if (num < 1)
+		return 0;
+
+	r = af9035_i2c_route(state, msg[0].addr);
+	if (!r)
+		return -ENXIO;
+	bus = r->bus;
+
+	/* only one bus lock is taken, transfer must stay on its bus */
+	for (i = 1; i < num; i++) {
+		r = af9035_i2c_route(state, msg[i].addr);
+		if (!r)
+			return -ENXIO;
+		if (r->bus != bus) {
+			deb_info("%s: mixed buses %d and %d\n", __func__,
+				bus, r->bus);
+			return -EINVAL;
+		}
+	}
+	i = 0;
 
-	if (mutex_lock_interruptible(&d->i2c_mutex) < 0)
+	/* command engine is shared, only transfers to the same bus are
+	   serialized so that demods can be set up at the same time */
+	lock = &state->i2c_lock[bus];
+	if (mutex_lock_interruptible(lock) < 0)
 		return -EAGAIN;
 
+	/* backend for tuner messages, the one needing fewer commands */
+	af9035_i2c_cost(state, msg, num, &tuner, &generic);
+
 	while (i < num) {
-		mbox = msg[i].buf[0];
+		r = af9035_i2c_route(state, msg[i].addr);
+		if (!r) {
+			ret = -ENXIO;
+			goto error;
+		}
+
+		/* tuner commands are queued, reads complete to caller buffer
+		   by the time whole transfer has been waited */
+		if (r->type == AF9035_I2C_TUNER) {
+			if (generic < tuner)
+				ret = af9035_i2c_generic_msg(&b.b, r, &msg[i],
+					num - i);
+			else
+				ret = af9035_i2c_tuner_msg(&b.b, r, &msg[i],
+					num - i);
+			if (ret < 0)
+				goto error;
+			i += ret;
+			ret = 0;
+			continue;
+		}
+
+		/* lists of single demod registers as written by af9033 */
+		ret = af9035_i2c_reg_list(state, r, &msg[i], num - i);
+		if (ret < 0)
+			goto error;
+		if (ret) {
+			i += ret;
+			ret = 0;
+			continue;
+		}
+
+		if (msg[i].len < 3) {
+			ret = -EOPNOTSUPP;
+			goto error;
+		}
+		mbox = msg[i].buf[0] + r->mbox;
 		reg = msg[i].buf[1] << 8;
 		reg += msg[i].buf[2];
+
 		if (num > i + 1 && (msg[i+1].flags & I2C_M_RD)) {
-			if (msg[i].addr ==
-				af9035_af9033_config[0].demod_address ||
-			    msg[i].addr ==
-				af9035_af9033_config[1].demod_address) {
-				if (af9035_af9033_config[1].demod_address && (msg[i].addr == af9035_af9033_config[1].demod_address))
-					mbox += 0x10;
-				ret = af9035_read_regs(d, mbox, reg,
-					&msg[i+1].buf[0], msg[i+1].len);
-			} else {
-				/* FIXME */
-				u8 wbuf[5];
-				u8 rbuf[BUF_SIZE];
-				struct af9035_req req = {CMD_REG_TUNER_READ,
-					LINK, sizeof(wbuf), wbuf, msg[i + 1].len,
-					rbuf};
-				if (af9035_af9033_config[1].tuner_address &&
-					(msg[i].addr == af9035_af9033_config[1].tuner_address)) {
-					msg[i].addr = af9035_af9033_config[0].tuner_address;
-					req.mbox += 0x10;
-				}
-				wbuf[0] = msg[i + 1].len; /* read len */
-				wbuf[1] = msg[i].addr; /* tuner i2c addr */
-				wbuf[2] = 0x01; /* reg width */
-				wbuf[3] = 0x00; /* reg MSB */
-				wbuf[4] = msg[i].buf[0]; /* reg LSB */
-				ret = af9035_rw_udev(d->udev, &req);
-				memcpy (msg[i + 1].buf, rbuf, msg[i + 1].len);
-			}
+			/* writes queued before must be done first */
+			ret = af9035_i2c_wait(&b, false);
+			if (ret)
+				goto error;
+
+			ret = af9035_read_regs(d, mbox, reg,
+				&msg[i+1].buf[0], msg[i+1].len);
 			i += 2;
 		} else {
-			if (msg[i].addr ==
-				af9035_af9033_config[0].demod_address ||
-			    msg[i].addr ==
-				af9035_af9033_config[1].demod_address) {
-				if (af9035_af9033_config[1].demod_address && (msg[i].addr == af9035_af9033_config[1].demod_address))
-					mbox += 0x10;
-				ret = af9035_write_regs(d, mbox, reg,
-					&msg[i].buf[3], msg[i].len-3);
-			} else {
-				u8 wbuf[BUF_SIZE];
-				struct af9035_req req = {CMD_REG_TUNER_WRITE,
-					LINK, 4 + msg[i].len, wbuf, 0, NULL};
-				if (af9035_af9033_config[1].tuner_address &&
-					(msg[i].addr == af9035_af9033_config[1].tuner_address)) {
-					msg[i].addr = af9035_af9033_config[0].tuner_address;
-					req.mbox += 0x10;
-				}
-				wbuf[0] = msg[i].len - 1; /* write len */
-				wbuf[1] = msg[i].addr; /* tuner i2c addr */
-				wbuf[2] = 0x01; /* reg width */
-				wbuf[3] = 0x00; /* reg MSB */
-				memcpy (&wbuf[4], msg[i].buf, msg[i].len);
-				ret = af9035_rw_udev(d->udev, &req);
+			/* writes are queued back to back, no need to wait */
+			u8 wbuf[AF9035_BUF_SIZE];
+			struct af9035_req req = {CMD_REG_DEMOD_WRITE, mbox, 0,
+				wbuf, 0, NULL};
+
+			if (msg[i].len + 3 > AF9035_BUF_SIZE - 6) {
+				ret = -EOPNOTSUPP;
+				goto error;
+			}
+			if (b.wr_num == ARRAY_SIZE(b.wr)) {
+				ret = af9035_i2c_wait(&b, false);
+				if (ret)
+					goto error;
 			}
+			req.wlen = af9035_demod_hdr(state, &req, reg,
+				msg[i].len - 3);
+			memcpy(&wbuf[req.wlen], &msg[i].buf[3],
+				msg[i].len - 3);
+			req.wlen += msg[i].len - 3;
+
+			b.wr[b.wr_num].mbox = mbox;
+			b.wr[b.wr_num].reg = reg;
+			b.wr[b.wr_num].val = &msg[i].buf[3];
+			b.wr[b.wr_num].len = msg[i].len - 3;
+			b.wr_num++;
+
+			ret = af9035_batch_add(&b.b, &req);
 			i += 1;
 		}
 		if (ret)
 			goto error;
-
 	}
 	ret = i;
 error:
-	mutex_unlock(&d->i2c_mutex);
+	tmp = af9035_i2c_wait(&b, ret < 0);
+	if (tmp && ret >= 0)
+		ret = tmp;
+
+	mutex_unlock(lock);
 
 	return ret;
 }
 
+/* older kernels have no own bit for it */
+#ifndef I2C_FUNC_NOSTART
+#define I2C_FUNC_NOSTART I2C_FUNC_PROTOCOL_MANGLING
+#endif
+
 static u32 af9035_i2c_func(struct i2c_adapter *adapter)
 {
-	return I2C_FUNC_I2C;
+	return I2C_FUNC_I2C | I2C_FUNC_NOSTART;
 }
 
 static struct i2c_algorithm af9035_i2c_algo = {
@@ -329,11 +1797,103 @@ static struct i2c_algorithm af9035_i2c_algo = {
 #endif
 };
 
+struct af9035_reg_bits {
+	u8 mbox;
+	u16 reg;
+	u8 pos;
+	u8 len;
+	u8 val;
+};
+
+#define AF9035_REG_BITS_MAX 20
+
+/* register bit writes in given order, reads and writes are batched */
+static int af9035_write_reg_bits_tab(struct dvb_usb_device *d,
+	const struct af9035_reg_bits *tab, int num)
+{
+	struct af9035_state *state = af9035_d_to_state(d);
+	struct af9035_reg_val rd[AF9035_REG_BITS_MAX], wr[AF9035_REG_BITS_MAX];
+	int ret, i, j, k, nrd = 0;
+	u8 mask;
+
+	if (num > AF9035_REG_BITS_MAX)
+		return -EINVAL;
+
+	/* read registers which are not fully overwritten, once */
+	for (i = 0; i < num; i++) {
+		if (tab[i].len == 8)
+			continue;
+		for (j = 0; j < nrd; j++) {
+			if (rd[j].mbox == tab[i].mbox && rd[j].reg == tab[i].reg)
+				break;
+		}
+		if (j < nrd)
+			continue;
+
+		rd[nrd].mbox = tab[i].mbox;
+		rd[nrd].reg = tab[i].reg;
+		nrd++;
+	}
+
+	/* shadowed registers are not read again, the rest is moved first */
+	for (i = 0, j = 0; i < nrd; i++) {
+		if (af9035_shadow_get(state, rd[i].mbox, rd[i].reg,
+			&rd[i].val))
+			continue;
+		swap(rd[i], rd[j]);
+		j++;
+	}
+
+	ret = af9035_rw_reg_list(state, rd, j, false);
+	if (ret)
+		return ret;
+
+	/* apply bits in order, latest value of the register is used */
+	for (i = 0; i < num; i++) {
+		wr[i].mbox = tab[i].mbox;
+		wr[i].reg = tab[i].reg;
+
+		if (tab[i].len == 8) {
+			wr[i].val = tab[i].val;
+			continue;
+		}
+
+		for (j = i - 1; j >= 0; j--) {
+			if (wr[j].mbox == wr[i].mbox && wr[j].reg == wr[i].reg)
+				break;
+		}
+		if (j >= 0) {
+			wr[i].val = wr[j].val;
+		} else {
+			for (k = 0; k < nrd; k++) {
+				if (rd[k].mbox == wr[i].mbox &&
+					rd[k].reg == wr[i].reg)
+					break;
+			}
+			wr[i].val = rd[k].val;
+		}
+
+		mask = regmask[tab[i].len - 1] << tab[i].pos;
+		wr[i].val = (wr[i].val & ~mask) |
+			((tab[i].val << tab[i].pos) & mask);
+	}
+
+	return af9035_rw_reg_list(state, wr, num, true);
+}
+
 static int af9035_init_endpoint(struct dvb_usb_device *d)
 {
-	int ret;
+	struct af9035_state *state = af9035_d_to_state(d);
+	int ret, n = 0;
 	u16 frame_size;
 	u8  packet_size;
+	struct af9035_reg_bits tab[AF9035_REG_BITS_MAX];
+
+#define AF9035_BITS(_mbox, _reg, _val) \
+	tab[n++] = (struct af9035_reg_bits) {_mbox, p_##_reg, _reg##_pos, \
+		_reg##_len, _val}
+#define AF9035_BYTE(_mbox, _reg, _val) \
+	tab[n++] = (struct af9035_reg_bits) {_mbox, _reg, 0, 8, _val}
 
 	if (d->udev->speed == USB_SPEED_FULL) {
 		frame_size = TS_USB11_FRAME_SIZE/4;
@@ -347,224 +1907,304 @@ static int af9035_init_endpoint(struct dvb_usb_device *d)
 		__func__, d->udev->speed, frame_size, packet_size);
 
 	/* enable EP4 reset */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_mp2_sw_rst,
-		reg_mp2_sw_rst_pos, reg_mp2_sw_rst_len, 1);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(OFDM, reg_mp2_sw_rst, 1);
 	/* enable EP5 reset */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_mp2if2_sw_rst,
-		reg_mp2if2_sw_rst_pos, reg_mp2if2_sw_rst_len, 1);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(OFDM, reg_mp2if2_sw_rst, 1);
 	/* disable EP4 */
-	ret = af9035_write_reg_bits(d, LINK, p_reg_ep4_tx_en,
-		reg_ep4_tx_en_pos, reg_ep4_tx_en_len, 0);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(LINK, reg_ep4_tx_en, 0);
 	/* disable EP5 */
-	ret = af9035_write_reg_bits(d, LINK, p_reg_ep5_tx_en,
-		reg_ep5_tx_en_pos, reg_ep5_tx_en_len, 0);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(LINK, reg_ep5_tx_en, 0);
 	/* disable EP4 NAK */
-	ret = af9035_write_reg_bits(d, LINK, p_reg_ep4_tx_nak,
-		reg_ep4_tx_nak_pos, reg_ep4_tx_nak_len, 0);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(LINK, reg_ep4_tx_nak, 0);
 	/* disable EP5 NAK */
-	ret = af9035_write_reg_bits(d, LINK, p_reg_ep5_tx_nak,
-		reg_ep5_tx_nak_pos, reg_ep5_tx_nak_len, 0);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(LINK, reg_ep5_tx_nak, 0);
 	/* enable EP4 */
-	ret = af9035_write_reg_bits(d, LINK, p_reg_ep4_tx_en,
-		reg_ep4_tx_en_pos, reg_ep4_tx_en_len, 1);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(LINK, reg_ep4_tx_en, 1);
 	/* EP4 xfer length */
-	ret = af9035_write_regs(d, LINK, p_reg_ep4_tx_len_7_0,
-		(u8 *) &frame_size, sizeof(frame_size));
-	if (ret)
-		goto error;
-
+	AF9035_BYTE(LINK, p_reg_ep4_tx_len_7_0, frame_size & 0xff);
+	AF9035_BYTE(LINK, p_reg_ep4_tx_len_7_0 + 1, frame_size >> 8);
 	/* EP4 packet size */
-	ret = af9035_write_reg(d, LINK, p_reg_ep4_max_pkt, packet_size);
-	if (ret)
-		goto error;
+	AF9035_BYTE(LINK, p_reg_ep4_max_pkt, packet_size);
 
 	/* configure EP5 for dual mode */
-	if (af9035_config.dual_mode) {
+	if (state->config.dual_mode) {
 		/* enable EP5 */
-		ret = af9035_write_reg_bits(d, LINK, p_reg_ep5_tx_en,
-			reg_ep5_tx_en_pos, reg_ep5_tx_en_len, 1);
-		if (ret)
-			goto error;
-
+		AF9035_BITS(LINK, reg_ep5_tx_en, 1);
 		/* EP5 xfer length */
-		ret = af9035_write_regs(d, LINK, p_reg_ep5_tx_len_7_0,
-			(u8 *) &frame_size, sizeof(frame_size));
-		if (ret)
-			goto error;
-
+		AF9035_BYTE(LINK, p_reg_ep5_tx_len_7_0, frame_size & 0xff);
+		AF9035_BYTE(LINK, p_reg_ep5_tx_len_7_0 + 1, frame_size >> 8);
 		/* EP5 packet size */
-		ret = af9035_write_reg(d, LINK, p_reg_ep5_max_pkt, packet_size);
-		if (ret)
-			goto error;
+		AF9035_BYTE(LINK, p_reg_ep5_max_pkt, packet_size);
 	}
 
 	/* enable / disable mp2if2 */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_mp2if2_en,
-		reg_mp2if2_en_pos, reg_mp2if2_en_len, af9035_config.dual_mode);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(OFDM, reg_mp2if2_en, state->config.dual_mode);
 	/* enable / disable tsis */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_tsis_en, reg_tsis_en_pos,
-		reg_tsis_en_len, af9035_config.dual_mode);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(OFDM, reg_tsis_en, state->config.dual_mode);
 	/* negate EP4 reset */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_mp2_sw_rst,
-		reg_mp2_sw_rst_pos, reg_mp2_sw_rst_len, 0);
-	if (ret)
-		goto error;
-
+	AF9035_BITS(OFDM, reg_mp2_sw_rst, 0);
 	/* negate EP5 reset */
-	ret = af9035_write_reg_bits(d, OFDM, p_reg_mp2if2_sw_rst,
-		reg_mp2if2_sw_rst_pos, reg_mp2if2_sw_rst_len, 0);
-	if (ret)
-		goto error;
+	AF9035_BITS(OFDM, reg_mp2if2_sw_rst, 0);
 
-error:
+#undef AF9035_BITS
+#undef AF9035_BYTE
+
+	ret = af9035_write_reg_bits_tab(d, tab, n);
 	if (ret)
 		err("endpoint init failed:%d", ret);
 	return ret;
 }
 
+/* short commands are used only after they read back what long ones do */
+static int af9035_short_probe(struct af9035_state *state)
+{
+	int ret;
+	u8 ver[4], tmp[4];
+
+	state->short_cmd = 0;
+	if (!af9035_short_cmd)
+		return 0;
+
+	/* LINK firmware version */
+	ret = af9035_read_regs_bis(state, LINK, 0x83e9, ver, sizeof(ver));
+	if (ret)
+		return ret;
+
+	/* read only check, writes always use long commands */
+	state->short_cmd = 1;
+	ret = af9035_read_regs_bis(state, LINK, 0x83e9, tmp, sizeof(tmp));
+	if (ret || memcmp(ver, tmp, sizeof(ver))) {
+		info("short commands not supported, using long ones");
+		state->short_cmd = 0;
+	}
+	deb_info("%s: short_cmd:%d\n", __func__, state->short_cmd);
+
+	return 0;
+}
+
 static int af9035_init(struct dvb_usb_device *d)
 {
 	int ret;
 	deb_info("%s:\n", __func__);
 
+	/* firmware was (re)booted */
+	af9035_shadow_invalidate(af9035_d_to_state(d));
+
+	ret = af9035_scatter_probe(af9035_d_to_state(d));
+	if (ret)
+		goto error;
+
+	ret = af9035_short_probe(af9035_d_to_state(d));
+	if (ret)
+		goto error;
+
+	af9035_phase_start(af9035_d_to_state(d), AF9035_PHASE_INIT_ENDPOINT);
 	ret = af9035_init_endpoint(d);
 	if (ret)
 		goto error;
+	af9035_phase_end(af9035_d_to_state(d), AF9035_PHASE_INIT_ENDPOINT);
+
+	/* tells resume whether registers set above survived */
+	ret = af9035_write_reg_bis(af9035_d_to_state(d), LINK,
+		AF9035_SCRATCH_REG, AF9035_SCRATCH_INIT);
 error:
 	return ret;
 }
 
-static int af9035_download_firmware(struct usb_device *udev,
-	const struct firmware *fw)
+/* queue segment data as back to back packets, caller waits the batch */
+static int af9035_download_segment(struct af9035_batch *b, u8 cmd,
+	const u8 *data, u32 len)
 {
-	u8 *fw_data_ptr = (u8 *) fw->data;
-	int i, j, len, packets, remainder, ret;
-	u8 wbuf[1];
-	u8 rbuf[4];
-	struct af9035_firmware_header fw_hdr;
-	struct af9035_req req = {0, LINK, 0, NULL, 1, rbuf};
-	struct af9035_req req_fw_dl = {CMD_FW_DOWNLOAD, LINK, 0, NULL, 0, NULL};
-	struct af9035_req req_rom = {CMD_SCATTER_WRITE, LINK, 0, NULL, 1, rbuf};
-	struct af9035_req req_fw_ver = {CMD_QUERYINFO, LINK, 1, wbuf, 4, rbuf};
+	/* ROM copy is acked, only status of the reply is used */
+	struct af9035_req req = {cmd, LINK, 0, NULL, 0, NULL};
+	int ret;
+
+	#define FW_PACKET_MAX_DATA 57 /* 63-4-2, packet_size-header-checksum */
+
+	while (len) {
+		req.wlen = min_t(u32, len, FW_PACKET_MAX_DATA);
+		req.wbuf = (u8 *) data;
+		ret = af9035_batch_add(b, &req);
+		if (ret)
+			return ret;
+		data += req.wlen;
+		len -= req.wlen;
+	}
+
+	return 0;
+}
+
+/* read segment table from beginning of the firmware file */
+static int af9035_fw_parse(struct af9035_fw *f)
+{
+	const u8 *data = f->fw->data;
+	u32 ofs, size = f->fw->size;
+	int i;
+
+	if (size < 1)
+		return -EINVAL;
+
+	f->hdr.segment_count = data[0];
+	deb_info("%s: fw segment count:%d\n", __func__, f->hdr.segment_count);
+	if (f->hdr.segment_count > SEGMENT_MAX_COUNT) {
+		warn("too big firmware segmen count:%d", f->hdr.segment_count);
+		f->hdr.segment_count = SEGMENT_MAX_COUNT;
+	}
+
+	ofs = 1 + 5 * f->hdr.segment_count;
+	if (ofs > size)
+		return -EINVAL;
 
-	/* read firmware segment info from beginning of the firmware file */
-	fw_hdr.segment_count = *fw_data_ptr++;
-	deb_info("%s: fw segment count:%d\n", __func__, fw_hdr.segment_count);
-	if (fw_hdr.segment_count > SEGMENT_MAX_COUNT) {
-		warn("too big firmware segmen count:%d", fw_hdr.segment_count);
-		fw_hdr.segment_count = SEGMENT_MAX_COUNT;
-	}
-	for (i = 0; i < fw_hdr.segment_count; i++) {
-		fw_hdr.segment[i].type = (*fw_data_ptr++);
-		fw_hdr.segment[i].len  = (*fw_data_ptr++) << 24;
-		fw_hdr.segment[i].len += (*fw_data_ptr++) << 16;
-		fw_hdr.segment[i].len += (*fw_data_ptr++) <<  8;
-		fw_hdr.segment[i].len += (*fw_data_ptr++) <<  0;
+	for (i = 0; i < f->hdr.segment_count; i++) {
+		f->hdr.segment[i].type = data[1 + 5 * i];
+		f->hdr.segment[i].len  = data[2 + 5 * i] << 24;
+		f->hdr.segment[i].len += data[3 + 5 * i] << 16;
+		f->hdr.segment[i].len += data[4 + 5 * i] <<  8;
+		f->hdr.segment[i].len += data[5 + 5 * i] <<  0;
+		f->hdr.segment[i].ofs = ofs;
 		deb_info("%s: fw segment type:%d len:%d\n", __func__,
-			fw_hdr.segment[i].type, fw_hdr.segment[i].len);
+			f->hdr.segment[i].type, f->hdr.segment[i].len);
+
+		if (f->hdr.segment[i].len > size - ofs)
+			return -EINVAL;
+		ofs += f->hdr.segment[i].len;
 	}
 
-	#define FW_PACKET_MAX_DATA 57 /* 63-4-2, packet_size-header-checksum */
+	return 0;
+}
+
+/* get firmware image, file is requested and parsed only when no device
+   holds it already */
+static struct af9035_fw *af9035_fw_get(struct af9035_state *state)
+{
+	struct af9035_fw *f;
+	int ret;
+
+	mutex_lock(&af9035_fw_mutex);
+
+	f = af9035_fw_cache;
+	if (f) {
+		if (crc32_le(~0, f->fw->data, f->fw->size) == f->crc) {
+			kref_get(&f->kref);
+			goto exit_unlock;
+		}
+		/* holders keep their reference, new devices get a fresh one */
+		err("cached firmware corrupted, reloading");
+		af9035_fw_cache = NULL;
+	}
+
+	f = kzalloc(sizeof(*f), GFP_KERNEL);
+	if (!f)
+		goto exit_unlock;
+
+	ret = request_firmware(&f->fw, AF9035_FIRMWARE,
+		&state->udev->dev);
+	if (ret) {
+		err("did not find the firmware file. (%s) err:%d",
+			AF9035_FIRMWARE, ret);
+		kfree(f);
+		f = NULL;
+		goto exit_unlock;
+	}
+
+	ret = af9035_fw_parse(f);
+	if (ret) {
+		err("firmware file %s is broken", AF9035_FIRMWARE);
+		release_firmware(f->fw);
+		kfree(f);
+		f = NULL;
+		goto exit_unlock;
+	}
+
+	kref_init(&f->kref);
+	f->crc = crc32_le(~0, f->fw->data, f->fw->size);
+	af9035_fw_cache = f;
+	deb_info("%s: firmware %s size:%zu crc:%08x\n", __func__,
+		AF9035_FIRMWARE, f->fw->size, f->crc);
+exit_unlock:
+	mutex_unlock(&af9035_fw_mutex);
 
-	/* download all segments */
-	for (i = 0; i < fw_hdr.segment_count; i++) {
-		deb_info("%s: segment type:%d\n", __func__,
-			fw_hdr.segment[i].type);
-		if (fw_hdr.segment[i].type == SEGMENT_FW_DOWNLOAD) {
+	return f;
+}
+
+/* LINK and OFDM firmware versions, as printed by af9033_attach() */
+static int af9035_fw_version(struct af9035_state *state, u8 *ver)
+{
+	int ret;
+
+	ret = af9035_read_regs_bis(state, LINK, 0x83e9, &ver[0], 4);
+	if (ret)
+		return ret;
+
+	return af9035_read_regs_bis(state, OFDM, 0x4191, &ver[4], 4);
+}
+
+static int af9035_fw_download(struct af9035_state *state,
+	const struct af9035_fw *f)
+{
+	/* download packets are not acked, keep whole pool on the wire */
+	struct af9035_batch b = { .state = state,
+		.max = AF9035_CMD_INFLIGHT_MAX };
+	const struct af9035_segment *seg;
+	int i, ret;
+	u8 wbuf[1];
+	u8 rbuf[4];
+	struct af9035_req req = {0, LINK, 0, NULL, 1, rbuf};
+	struct af9035_req req_fw_ver = {CMD_QUERYINFO, LINK, 1, wbuf, 4, rbuf};
+
+	/* download all segments, EP2 keeps packet order so the end packet can
+	   be queued right after the data */
+	for (i = 0; i < f->hdr.segment_count; i++) {
+		seg = &f->hdr.segment[i];
+		deb_info("%s: segment type:%d\n", __func__, seg->type);
+		if (seg->type == SEGMENT_FW_DOWNLOAD) {
 			/* download begin packet */
 			req.cmd = CMD_FW_DOWNLOAD_BEGIN;
-			ret = af9035_rw_udev(udev, &req);
-			if (ret) {
-				err("firmware download failed:%d", ret);
-				goto error;
-			}
+			ret = af9035_ctrl_msg(state, &req);
+			if (ret)
+				goto error_segment;
+
+			ret = af9035_download_segment(&b, CMD_FW_DOWNLOAD,
+				f->fw->data + seg->ofs, seg->len);
+			if (ret)
+				goto error_segment;
 
-			packets = fw_hdr.segment[i].len / FW_PACKET_MAX_DATA;
-			remainder = fw_hdr.segment[i].len % FW_PACKET_MAX_DATA;
-			len = FW_PACKET_MAX_DATA;
-			for (j = 0; j <= packets; j++) {
-				if (j == packets)  /* size of the last packet */
-					len = remainder;
-
-				req_fw_dl.wlen = len;
-				req_fw_dl.wbuf = fw_data_ptr;
-				ret = af9035_rw_udev(udev, &req_fw_dl);
-				if (ret) {
-					err("firmware download failed at " \
-						"segment:%d packet:%d err:%d", \
-						i, j, ret);
-					goto error;
-				}
-				fw_data_ptr += len;
-			}
 			/* download end packet */
 			req.cmd = CMD_FW_DOWNLOAD_END;
-			ret = af9035_rw_udev(udev, &req);
-			if (ret) {
-				err("firmware download failed:%d", ret);
-				goto error;
-			}
-		} else if (fw_hdr.segment[i].type == SEGMENT_ROM_COPY){
-			packets = fw_hdr.segment[i].len / FW_PACKET_MAX_DATA;
-			remainder = fw_hdr.segment[i].len % FW_PACKET_MAX_DATA;
-			len = FW_PACKET_MAX_DATA;
-			for (j = 0; j <= packets; j++) {
-				if (j == packets)  /* size of the last packet */
-					len = remainder;
-
-				req_rom.wlen = len;
-				req_rom.wbuf = fw_data_ptr;
-				ret = af9035_rw_udev(udev, &req_rom);
-				if (ret) {
-					err("firmware download failed at " \
-						"segment:%d packet:%d err:%d", \
-						i, j, ret);
-					goto error;
-				}
-				fw_data_ptr += len;
-			}
+			ret = af9035_batch_add(&b, &req);
+			if (ret)
+				goto error_segment;
+
+			/* rbuf is shared by the begin and end packets */
+			ret = af9035_batch_wait(&b);
+			if (ret)
+				goto error_segment;
+		} else if (seg->type == SEGMENT_ROM_COPY) {
+			ret = af9035_download_segment(&b, CMD_SCATTER_WRITE,
+				f->fw->data + seg->ofs, seg->len);
+			if (ret)
+				goto error_segment;
 		} else {
 			deb_info("%s: segment type:%d not implemented\n",
-				__func__, fw_hdr.segment[i].type);
+				__func__, seg->type);
 		}
 	}
 
+	ret = af9035_batch_wait(&b);
+	if (ret) {
+		err("firmware download failed:%d", ret);
+		goto error;
+	}
+
 	/* firmware loaded, request boot */
 	req.cmd = CMD_BOOT;
-	ret = af9035_rw_udev(udev, &req);
+	ret = af9035_ctrl_msg(state, &req);
 	if (ret)
 		goto error;
 
 	/* ensure firmware starts */
 	wbuf[0] = 1;
-	ret = af9035_rw_udev(udev, &req_fw_ver);
+	ret = af9035_ctrl_msg(state, &req_fw_ver);
 	if (ret)
 		goto error;
 
@@ -575,151 +2215,203 @@ static int af9035_download_firmware(struct usb_device *udev,
 		err("firmware did not run");
 		ret = -EIO;
 	}
+	goto error;
 
+error_segment:
+	err("firmware download failed at segment:%d err:%d", i, ret);
+	af9035_batch_wait(&b);
 error:
 	if (ret)
 		deb_info("%s: failed:%d\n", __func__, ret);
 
-	return ret;
+	/* registers written before boot are not valid anymore */
+	af9035_shadow_invalidate(state);
+
+	return ret;
+}
+
+/* download firmware from the shared image unless it runs already, versions
+   seen on the first stick booted from the image are checked on the others */
+static int af9035_fw_load(struct af9035_state *state)
+{
+	struct af9035_fw *f;
+	int ret;
+	u8 wbuf[1] = {1};
+	u8 rbuf[4], ver[8];
+	struct af9035_req req = {CMD_QUERYINFO, LINK, sizeof(wbuf), wbuf,
+		sizeof(rbuf), rbuf};
+
+	ret = af9035_ctrl_msg(state, &req);
+	if (ret)
+		return ret;
+
+	if (rbuf[0] || rbuf[1] || rbuf[2] || rbuf[3]) {
+		/* warm, image is only kept for resume that finds it lost */
+		if (!state->fw)
+			state->fw = af9035_fw_get(state);
+		if (!state->fw)
+			warn("no firmware image, can't reload it after suspend");
+
+		ret = af9035_fw_version(state, ver);
+		if (ret)
+			return ret;
+
+		mutex_lock(&af9035_fw_mutex);
+		f = af9035_fw_cache;
+		if (f && f->ver_valid && memcmp(f->ver, ver, sizeof(ver)))
+			info("running firmware differs from %s, keeping it",
+				AF9035_FIRMWARE);
+		mutex_unlock(&af9035_fw_mutex);
+		deb_info("%s: firmware running, download skipped\n", __func__);
+		return 0;
+	}
+
+	if (!state->fw) {
+		state->fw = af9035_fw_get(state);
+		if (!state->fw)
+			return -ENOENT;
+	}
+	f = state->fw;
+
+	ret = af9035_fw_download(state, f);
+	if (ret)
+		return ret;
+
+	ret = af9035_fw_version(state, ver);
+	if (ret)
+		return ret;
+
+	mutex_lock(&af9035_fw_mutex);
+	if (!f->ver_valid) {
+		memcpy(f->ver, ver, sizeof(ver));
+		f->ver_valid = 1;
+	} else if (memcmp(f->ver, ver, sizeof(ver))) {
+		err("firmware version mismatch after download");
+		ret = -EIO;
+	}
+	mutex_unlock(&af9035_fw_mutex);
+
+	return ret;
+}
+
+/* dvb-usb callback, firmware is normally loaded already in probe and file
+   given here is not used as the shared image is */
+static int af9035_download_firmware(struct usb_device *udev,
+	const struct firmware *fw)
+{
+	struct af9035_state *state = af9035_state_find(udev);
+
+	if (!state)
+		return -ENODEV;
+
+	return af9035_fw_load(state);
 }
 
-static int af9035_read_eeprom_reg(struct usb_device *udev, u16 reg, u8 *val)
+/* whole config area of the EEPROM with one read, long command as the
+   firmware may not run yet */
+static int af9035_read_eeprom(struct af9035_state *state,
+	struct af9035_eeprom *ee)
 {
-	u8 wbuf[] = {1, 2, 0, 0, reg >> 8, reg & 0xff};
-	struct af9035_req req = {CMD_REG_DEMOD_READ, LINK, sizeof(wbuf), wbuf,
-		1, val};
-	return af9035_rw_udev(udev, &req);
+	u8 buf[EEPROM_CONFIG_LEN];
+	u8 *p;
+	int ret, i;
+
+	ret = af9035_read_regs_bis(state, LINK, EEPROM_CONFIG_ADDR, buf,
+		sizeof(buf));
+	if (ret)
+		return ret;
+
+	ee->ir_mode = buf[EEPROM_OFS(EEPROM_IR_MODE)];
+	ee->selsuspend = buf[EEPROM_OFS(EEPROM_SELSUSPEND)];
+	ee->ts_mode = buf[EEPROM_OFS(EEPROM_TS_MODE)];
+	ee->twowire_addr = buf[EEPROM_OFS(EEPROM_2WIREADDR)];
+	ee->suspend = buf[EEPROM_OFS(EEPROM_SUSPEND)];
+	ee->ir_type = buf[EEPROM_OFS(EEPROM_IR_TYPE)];
+
+	for (i = 0; i < 2; i++) {
+		p = &buf[i * EEPROM_SHIFT];
+		ee->adap[i].saw_bw = p[EEPROM_OFS(EEPROM_SAW_BW1)];
+		ee->adap[i].xtal = p[EEPROM_OFS(EEPROM_XTAL1)];
+		ee->adap[i].spec_inv = p[EEPROM_OFS(EEPROM_SPECINV1)];
+		ee->adap[i].if_freq = p[EEPROM_OFS(EEPROM_IFFREQH1)] << 8 |
+			p[EEPROM_OFS(EEPROM_IFFREQL1)];
+		ee->adap[i].mt2060_if1 = p[EEPROM_OFS(EEPROM_IF1H1)] << 8 |
+			p[EEPROM_OFS(EEPROM_IF1L1)];
+		ee->adap[i].tuner_id = p[EEPROM_OFS(EEPROM_TUNER_ID1)];
+	}
+
+	return 0;
 }
 
-static int af9035_read_config(struct usb_device *udev)
+static int af9035_read_config(struct af9035_state *state)
 {
+	struct usb_device *udev = state->udev;
+	struct af9035_eeprom *ee = &state->eeprom;
 	int ret;
-	u8 val, i, offset = 0;
-
-	/* IR remote controller */
-	ret = af9035_read_eeprom_reg(udev, EEPROM_IR_MODE, &val);
-	if (ret)
-		goto error;
-	deb_info("%s: IR mode:%d\n", __func__, val);
+	u8 val, i;
 
-	/* TS mode - one or two receivers */
-	ret = af9035_read_eeprom_reg(udev, EEPROM_TS_MODE, &val);
+	ret = af9035_read_eeprom(state, ee);
 	if (ret)
 		goto error;
-	af9035_config.dual_mode = val;
-	deb_info("%s: TS mode:%d\n", __func__, af9035_config.dual_mode);
 
-	/* Set adapter0 buffer size according to USB port speed, adapter1 buffer
-	   size can be static because it is enabled only USB2.0 */
-	for (i = 0; i < af9035_properties_count; i++) {
-		/* USB1.1 set smaller buffersize and disable 2nd adapter */
-		if (udev->speed == USB_SPEED_FULL) {
-#ifdef V4L2_REFACTORED_MFE_CODE
-			af9035_properties[i].adapter[0].fe[0].stream.u.bulk.buffersize
-#else
-			af9035_properties[i].adapter[0].stream.u.bulk.buffersize
-#endif
-				= TS_USB11_MAX_PACKET_SIZE;
-			/* disable 2nd adapter because we don't have
-			   PID-filters */
-			af9035_config.dual_mode = 0;
-		} else {
-#ifdef V4L2_REFACTORED_MFE_CODE
-			af9035_properties[i].adapter[0].fe[0].stream.u.bulk.buffersize
-#else
-			af9035_properties[i].adapter[0].stream.u.bulk.buffersize
-#endif
-				= TS_USB20_FRAME_SIZE;
-		}
-	}
+	/* IR remote controller */
+	deb_info("%s: IR mode:%d\n", __func__, ee->ir_mode);
 
-	if (af9035_config.dual_mode) {
-		/* read 2nd demodulator I2C address */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_2WIREADDR, &val);
-		if (ret)
-			goto error;
-		deb_info("%s: 2nd demod I2C addr:%02x\n", __func__, val);
-		af9035_af9033_config[1].demod_address = val;
-		/* enable 2nd adapter */
-		for (i = 0; i < af9035_properties_count; i++)
-			af9035_properties[i].num_adapters = 2;
-	} else {
-		 /* disable 2nd adapter */
-		for (i = 0; i < af9035_properties_count; i++)
-			af9035_properties[i].num_adapters = 1;
+	/* TS mode - one or two receivers */
+	state->config.dual_mode = ee->ts_mode;
+	deb_info("%s: TS mode:%d\n", __func__, state->config.dual_mode);
+
+	/* USB1.1 disable 2nd adapter because we don't have PID-filters */
+	if (udev->speed == USB_SPEED_FULL)
+		state->config.dual_mode = 0;
+
+	if (state->config.dual_mode) {
+		/* 2nd demodulator I2C address */
+		deb_info("%s: 2nd demod I2C addr:%02x\n", __func__,
+			ee->twowire_addr);
+		state->af9033_config[1].demod_address = ee->twowire_addr;
 	}
 
-	for (i = 0; i < af9035_properties[0].num_adapters; i++) {
-		if (i == 1)
-			offset =  EEPROM_SHIFT;
-
+	for (i = 0; i < 1 + state->config.dual_mode; i++) {
 		/* saw BW */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_SAW_BW1 + offset,
-			&val);
-		if (ret)
-			goto error;
-		deb_info("%s: [%d] saw BW:%d\n", __func__, i, val);
+		deb_info("%s: [%d] saw BW:%d\n", __func__, i,
+			ee->adap[i].saw_bw);
 
 		/* xtal */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_XTAL1 + offset, &val);
-		if (ret)
-			goto error;
-		deb_info("%s: [%d] xtal:%d\n", __func__, i, val);
+		deb_info("%s: [%d] xtal:%d\n", __func__, i, ee->adap[i].xtal);
 
 		/* RF spectrum inversion */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_SPECINV1 + offset,
-			&val);
-		if (ret)
-			goto error;
-		deb_info("%s: [%d] RF spectrum inv:%d\n", __func__, i, val);
+		deb_info("%s: [%d] RF spectrum inv:%d\n", __func__, i,
+			ee->adap[i].spec_inv);
 
 		/* IF */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_IFFREQH1 + offset,
-			&val);
-		if (ret)
-			goto error;
-		af9035_af9033_config[i].if_freq = val << 8;
-		ret = af9035_read_eeprom_reg(udev, EEPROM_IFFREQL1 + offset,
-			&val);
-		if (ret)
-			goto error;
-		af9035_af9033_config[i].if_freq += val;
+		state->af9033_config[i].if_freq = ee->adap[i].if_freq;
 		deb_info("%s: [%d] IF:%d\n", __func__, i,
-			af9035_af9033_config[0].if_freq);
+			state->af9033_config[i].if_freq);
 
 		/* MT2060 IF1 */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_IF1H1 + offset, &val);
-		if (ret)
-			goto error;
-		af9035_config.mt2060_if1[i] = val << 8;
-		ret = af9035_read_eeprom_reg(udev, EEPROM_IF1L1 + offset, &val);
-		if (ret)
-			goto error;
-		af9035_config.mt2060_if1[i] += val;
+		state->config.mt2060_if1[i] = ee->adap[i].mt2060_if1;
 		deb_info("%s: [%d] MT2060 IF1:%d\n", __func__, i,
-			af9035_config.mt2060_if1[i]);
+			state->config.mt2060_if1[i]);
 
 		/* tuner */
-		ret = af9035_read_eeprom_reg(udev, EEPROM_TUNER_ID1 + offset,
-			&val);
-		if (ret)
-			goto error;
+		val = ee->adap[i].tuner_id;
 		switch (val) {
 		case AF9033_TUNER_TUA9001:
-			af9035_af9033_config[i].rf_spec_inv = 1;
+			state->af9033_config[i].rf_spec_inv = 1;
 			break;
 		case AF9033_TUNER_MXL5007t:
-			af9035_af9033_config[i].rf_spec_inv = 1;
+			state->af9033_config[i].rf_spec_inv = 1;
 			break;
                 case AF9033_TUNER_TDA18218:
-			af9035_af9033_config[i].rf_spec_inv = 1;
+			state->af9033_config[i].rf_spec_inv = 1;
 			break;
 		default:
 			warn("tuner ID:%d not supported, please report!", val);
 			return -ENODEV;
 		};
 
-		af9035_af9033_config[i].tuner = val;
+		state->af9033_config[i].tuner = val;
 		deb_info("%s: [%d] tuner ID:%d\n", __func__, i, val);
 	}
 
@@ -734,8 +2426,8 @@ error:
 		case USB_PID_AVERMEDIA_B835:
 			deb_info("%s: AverMedia A825/A835/B835: overriding config\n", __func__);
 			/* set correct IF */
-			for (i = 0; i < af9035_properties[0].num_adapters; i++) {
-				af9035_af9033_config[i].if_freq = 4570000;
+			for (i = 0; i < 1 + state->config.dual_mode; i++) {
+				state->af9033_config[i].if_freq = 4570000;
 			}
 			break;
 		default:
@@ -746,34 +2438,52 @@ error:
 	return ret;
 }
 
-static int af9035_aux_init(struct usb_device *d)
+/* adapt device properties to the config read from the EEPROM */
+static void af9035_set_properties(struct af9035_state *state,
+	struct dvb_usb_device_properties *props)
+{
+	/* Set adapter0 buffer size according to USB port speed, adapter1 buffer
+	   size can be static because it is enabled only USB2.0 */
+#ifdef V4L2_REFACTORED_MFE_CODE
+	props->adapter[0].fe[0].stream.u.bulk.buffersize
+#else
+	props->adapter[0].stream.u.bulk.buffersize
+#endif
+		= state->udev->speed == USB_SPEED_FULL ?
+		TS_USB11_MAX_PACKET_SIZE : TS_USB20_FRAME_SIZE;
+
+	/* enable / disable 2nd adapter */
+	props->num_adapters = 1 + state->config.dual_mode;
+}
+
+static int af9035_aux_init(struct af9035_state *state)
 {
 	int ret;
 	u8 tmp, i;
 
 	/* get demod crystal and ADC freqs */
-	ret = af9035_read_reg_bits_bis(d, LINK,
+	ret = af9035_read_reg_bits_bis(state, LINK,
 		r_io_mux_pwron_clk_strap, io_mux_pwron_clk_strap_pos,
 		io_mux_pwron_clk_strap_len, &tmp);
 	if (ret)
 		goto error;
 
-	for (i = 0; i < af9035_properties[0].num_adapters; i++) {
-		af9035_af9033_config[i].crystal_clock =
+	for (i = 0; i < 1 + state->config.dual_mode; i++) {
+		state->af9033_config[i].crystal_clock =
 			clock_table[tmp].crystal;
-		af9035_af9033_config[i].adc_clock =
+		state->af9033_config[i].adc_clock =
 			clock_table[tmp].adc;
 	}
 
 	/* write 2nd demod I2C address to device */
-	ret = af9035_write_reg_bis(d, LINK, 0x417f,
-		af9035_af9033_config[1].demod_address);
+	ret = af9035_write_reg_bis(state, LINK, 0x417f,
+		state->af9033_config[1].demod_address);
 	if (ret)
 		goto error;
 
 	/* enable / disable clock out for 2nd demod for power saving */
-	ret = af9035_write_reg_bis(d, LINK, p_reg_top_clkoen,
-		af9035_config.dual_mode);
+	ret = af9035_write_reg_bis(state, LINK, p_reg_top_clkoen,
+		state->config.dual_mode);
 
 error:
 	return ret;
@@ -789,8 +2499,13 @@ static int af9035_identify_state(struct usb_device *udev,
 	u8 rbuf[4];
 	struct af9035_req req = {CMD_QUERYINFO, 0, sizeof(wbuf), wbuf,
 		sizeof(rbuf), rbuf};
+	struct af9035_state *state = af9035_state_find(udev);
+
+	if (!state)
+		return -ENODEV;
 
-	ret = af9035_rw_udev(udev, &req);
+	af9035_phase_start(state, AF9035_PHASE_IDENTIFY);
+	ret = af9035_ctrl_msg(state, &req);
 	if (ret)
 		return ret;
 
@@ -800,25 +2515,52 @@ static int af9035_identify_state(struct usb_device *udev,
 		*cold = 0;
 	else
 		*cold = 1;
+	af9035_phase_end(state, AF9035_PHASE_IDENTIFY);
 
 	return ret;
 }
 
 static int af9035_af9033_frontend_attach(struct dvb_usb_adapter *adap)
 {
+	struct af9035_state *state;
+	int ret;
+
+	/* bound by power_ctrl already, unless dvb-usb skipped it */
+	if (adap->id == 0 && !af9035_d_to_state(adap->dev))
+		*(struct af9035_state **) adap->dev->priv =
+			af9035_state_find(adap->dev->udev);
+
+	state = af9035_d_to_state(adap->dev);
+	if (!state)
+		return -ENODEV;
+	state->d = adap->dev;
+
+	af9035_phase_start(state, AF9035_PHASE_FE_ATTACH + adap->id);
+
+	/* demod of adapter n is chip n of the bridge */
+	ret = af9035_i2c_route_add(state,
+		state->af9033_config[adap->id].demod_address, AF9035_I2C_DEMOD,
+		adap->id, state->af9033_config[adap->id].demod_address);
+	if (ret)
+		return ret;
+
 	/* attach demodulator */
 #ifdef V4L2_REFACTORED_MFE_CODE
-	adap->fe_adap[0].fe = dvb_attach(af9033_attach, &af9035_af9033_config[adap->id],
+	adap->fe_adap[0].fe = dvb_attach(af9033_attach, &state->af9033_config[adap->id],
 		&adap->dev->i2c_adap);
 
 
-	return adap->fe_adap[0].fe == NULL ? -ENODEV : 0;
+	ret = adap->fe_adap[0].fe == NULL ? -ENODEV : 0;
 #else
-	adap->fe = dvb_attach(af9033_attach, &af9035_af9033_config[adap->id],
+	adap->fe = dvb_attach(af9033_attach, &state->af9033_config[adap->id],
 		&adap->dev->i2c_adap);
 
-	return adap->fe == NULL ? -ENODEV : 0;
+	ret = adap->fe == NULL ? -ENODEV : 0;
 #endif
+	if (!ret)
+		af9035_phase_end(state, AF9035_PHASE_FE_ATTACH + adap->id);
+
+	return ret;
 }
 
 static struct tua9001_config af9035_tua9001_config[] = {
@@ -850,22 +2592,119 @@ static struct mxl5007t_config af9035_mxl5007t_config[] = {
 static struct tda18218_config af9035_tda18218_config[] = {
 	{
 		.i2c_address = 0xc0,
-		.i2c_wr_max = 21, /* max wr bytes AF9015 I2C adap can handle at once */
+		.i2c_wr_max = AF9035_TUNER_WR_MAX,
 	} , {
 		.i2c_address = 0xc1,
-		.i2c_wr_max = 21, /* max wr bytes AF9015 I2C adap can handle at once */
+		.i2c_wr_max = AF9035_TUNER_WR_MAX,
 	}
 };
 
-static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
+/* poll tuner register until the chip answers after reset, when it does not
+   answer in timeout_ms that is as long as the fixed wait used to be */
+static int af9035_tuner_wait_ready(struct dvb_usb_adapter *adap,
+	struct dvb_frontend *fe, u8 addr, u8 *reg, u8 reg_len, u8 id_mask,
+	u8 id, unsigned int timeout_ms)
 {
+	unsigned long timeout = jiffies + msecs_to_jiffies(timeout_ms);
+	unsigned int polls = 0;
+	u8 val;
 	int ret;
-	deb_info("%s: \n", __func__);
+	struct i2c_msg msg[2] = {
+		{ .addr = addr, .flags = 0, .buf = reg, .len = reg_len },
+		{ .addr = addr, .flags = I2C_M_RD, .buf = &val, .len = 1 },
+	};
+
+	if (fe->ops.i2c_gate_ctrl)
+		fe->ops.i2c_gate_ctrl(fe, 1);
+
+	do {
+		usleep_range(AF9035_TUNER_POLL_US, AF9035_TUNER_POLL_US * 2);
+		polls++;
+		ret = i2c_transfer(&adap->dev->i2c_adap, msg, 2);
+		if (ret == 2 && (val & id_mask) == id) {
+			ret = 0;
+			break;
+		}
+		ret = -ETIMEDOUT;
+	} while (time_before(jiffies, timeout));
+
+	if (fe->ops.i2c_gate_ctrl)
+		fe->ops.i2c_gate_ctrl(fe, 0);
+
+	deb_info("%s: tuner:%02x ret:%d polls:%u\n", __func__, addr, ret,
+		polls);
+
+	return ret;
+}
+
+/* generic I2C commands are used for a tuner only after they read back the
+   same as tuner commands, bus number of them is not known for all firmwares */
+static void af9035_generic_probe(struct dvb_usb_adapter *adap, u8 addr,
+	u8 *reg, u8 reg_len)
+{
+	struct af9035_state *state = af9035_d_to_state(adap->dev);
+	struct af9035_i2c_route *r = &state->i2c_route[addr];
+	struct af9035_batch b = { .state = state };
+#ifdef V4L2_REFACTORED_MFE_CODE
+	struct dvb_frontend *fe = adap->fe_adap[0].fe;
+#else
+	struct dvb_frontend *fe = adap->fe;
+#endif
+	u8 val[2] = {0, 0};
+	struct i2c_msg msg[2][2] = {
+		{
+			{ .addr = addr, .flags = 0, .buf = reg, .len = reg_len },
+			{ .addr = addr, .flags = I2C_M_RD, .buf = &val[0],
+				.len = 1 },
+		}, {
+			{ .addr = addr, .flags = 0, .buf = reg, .len = reg_len },
+			{ .addr = addr, .flags = I2C_M_RD, .buf = &val[1],
+				.len = 1 },
+		}
+	};
+	int ret, tmp;
+
+	r->generic = 0;
+	if (!af9035_generic_i2c || !reg_len)
+		return;
+
+	if (fe->ops.i2c_gate_ctrl)
+		fe->ops.i2c_gate_ctrl(fe, 1);
+
+	mutex_lock(&state->i2c_lock[r->bus]);
+	ret = af9035_i2c_tuner_msg(&b, r, msg[0], 2);
+	if (ret >= 0)
+		ret = af9035_i2c_generic_msg(&b, r, msg[1], 2);
+	if (ret >= 0)
+		ret = af9035_i2c_generic_msg(&b, r, &msg[1][1], 1);
+	tmp = af9035_batch_wait(&b);
+	mutex_unlock(&state->i2c_lock[r->bus]);
+
+	if (fe->ops.i2c_gate_ctrl)
+		fe->ops.i2c_gate_ctrl(fe, 0);
+
+	if (ret >= 0 && !tmp && val[0] == val[1])
+		r->generic = 1;
+	deb_info("%s: tuner:%02x generic:%d ret:%d/%d val:%02x/%02x\n",
+		__func__, addr, r->generic, ret, tmp, val[0], val[1]);
+}
+
+/* tuner GPIOs of the board, reset and power up, done at attach and again
+   when resume finds the device lost its state */
+static int af9035_tuner_power_on(struct dvb_usb_adapter *adap)
+{
+	struct af9035_state *state = af9035_d_to_state(adap->dev);
+#ifdef V4L2_REFACTORED_MFE_CODE
+	struct dvb_frontend *fe = adap->fe_adap[0].fe;
+#else
+	struct dvb_frontend *fe = adap->fe;
+#endif
+	int ret = 0;
+	u8 reg[2];
 
-	switch (af9035_af9033_config[adap->id].tuner) {
+	switch (state->af9033_config[adap->id].tuner) {
 	case AF9033_TUNER_TUA9001:
-		af9035_af9033_config[adap->id].tuner_address = af9035_tua9001_config[adap->id].i2c_address;
-		af9035_af9033_config[adap->id].tuner_address += adap->id;
+	case AF9033_TUNER_TDA18218:
 		if (adap->id == 0) {
 			/* gpiot3 TUA9001 RESETN
 			   gpiot2 TUA9001 RXEN */
@@ -882,10 +2721,10 @@ static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
 				p_reg_top_gpiot3_on, reg_top_gpiot3_on_pos,
 				reg_top_gpiot3_on_len, 1);
 
-			/* reset tuner */
+			/* reset tuner, msleep(1) could take two jiffies */
 			ret = af9035_write_reg_bits(adap->dev, LINK, p_reg_top_gpiot3_o,
 				 reg_top_gpiot3_o_pos, reg_top_gpiot3_o_len, 0);
-			msleep(1);
+			usleep_range(1000, 2000);
 			ret = af9035_write_reg_bits(adap->dev, LINK, p_reg_top_gpiot3_o,
 				 reg_top_gpiot3_o_pos, reg_top_gpiot3_o_len, 1);
 
@@ -894,17 +2733,18 @@ static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
 				 reg_top_gpiot2_o_pos, reg_top_gpiot2_o_len, 1);
 		}
 
-#ifdef V4L2_REFACTORED_MFE_CODE
-		ret = dvb_attach(tua9001_attach, adap->fe_adap[0].fe, &adap->dev->i2c_adap,
-#else
-		ret = dvb_attach(tua9001_attach, adap->fe, &adap->dev->i2c_adap,
-#endif
-			&af9035_tua9001_config[adap->id]) == NULL ? -ENODEV : 0;
+		if (state->af9033_config[adap->id].tuner !=
+			AF9033_TUNER_TDA18218)
+			break;
 
+		/* attach reads chip ID once, make sure it can answer */
+		reg[0] = 0x00; /* R00_ID */
+		if (af9035_tuner_wait_ready(adap, fe,
+			state->af9033_config[adap->id].tuner_address,
+			reg, 1, 0xff, 0xc0, AF9035_TDA18218_RESET_MS))
+			warn("TDA18218 not ready after reset");
 		break;
 	case AF9033_TUNER_MXL5007t:
-		af9035_af9033_config[adap->id].tuner_address = 0xc0;
-		af9035_af9033_config[adap->id].tuner_address += adap->id;
 		if (adap->id == 0) {
 			ret = af9035_write_reg(adap->dev, LINK,
 				p_reg_top_gpioh12_en,
@@ -918,13 +2758,20 @@ static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
 				p_reg_top_gpioh12_o,
 				0);
 
+			/* reset pulse width */
 			msleep(30);
 
 			ret = af9035_write_reg(adap->dev, LINK,
 				p_reg_top_gpioh12_o,
 				1);
 
-			msleep(300);
+			/* chip ID register answers once tuner is out of reset */
+			reg[0] = 0xfb;
+			reg[1] = 0xd9;
+			if (af9035_tuner_wait_ready(adap, fe,
+				state->af9033_config[adap->id].tuner_address,
+				reg, 2, 0x00, 0x00, AF9035_MXL5007T_RESET_MS))
+				warn("MxL5007T not ready after reset");
 
 			ret = af9035_write_reg(adap->dev, LINK,
 				p_reg_top_gpioh4_en,
@@ -950,59 +2797,121 @@ static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
 				p_reg_top_gpioh3_o,
 				1);
 		}
+		break;
+	}
+
+	return ret;
+}
+
+static int af9035_tuner_attach(struct dvb_usb_adapter *adap)
+{
+	struct af9035_state *state = af9035_d_to_state(adap->dev);
+	int ret;
+	u8 addr, real_addr, id_reg[2], id_len = 0;
+	deb_info("%s: \n", __func__);
+
+	af9035_phase_start(state, AF9035_PHASE_TUNER_ATTACH + adap->id);
+
+	/* tuners are at the same address behind each demod, drivers of the
+	   2nd one use the next address to tell them apart */
+	switch (state->af9033_config[adap->id].tuner) {
+	case AF9033_TUNER_TUA9001:
+		addr = af9035_tua9001_config[adap->id].i2c_address;
+		real_addr = af9035_tua9001_config[0].i2c_address;
+		break;
+	case AF9033_TUNER_MXL5007t:
+		addr = 0xc0 + adap->id;
+		real_addr = 0xc0;
+		id_reg[0] = 0xfb;
+		id_reg[1] = 0xd9;
+		id_len = 2;
+		break;
+	case AF9033_TUNER_TDA18218:
+		addr = af9035_tda18218_config[adap->id].i2c_address;
+		real_addr = af9035_tda18218_config[0].i2c_address;
+		id_reg[0] = 0x00; /* R00_ID */
+		id_len = 1;
+		break;
+	default:
+		err("unknown tuner ID:%d",
+			state->af9033_config[adap->id].tuner);
+		return -ENODEV;
+	}
+
+	state->af9033_config[adap->id].tuner_address = addr;
+	ret = af9035_i2c_route_add(state, addr, AF9035_I2C_TUNER, adap->id,
+		real_addr);
+	if (ret)
+		return ret;
+
+	af9035_tuner_power_on(adap);
+	af9035_generic_probe(adap, addr, id_reg, id_len);
+
+	switch (state->af9033_config[adap->id].tuner) {
+	case AF9033_TUNER_TUA9001:
+#ifdef V4L2_REFACTORED_MFE_CODE
+		ret = dvb_attach(tua9001_attach, adap->fe_adap[0].fe, &adap->dev->i2c_adap,
+#else
+		ret = dvb_attach(tua9001_attach, adap->fe, &adap->dev->i2c_adap,
+#endif
+			&af9035_tua9001_config[adap->id]) == NULL ? -ENODEV : 0;
 
+		break;
+	case AF9033_TUNER_MXL5007t:
 #ifdef V4L2_REFACTORED_MFE_CODE
 		ret = dvb_attach(mxl5007t_attach, adap->fe_adap[0].fe, &adap->dev->i2c_adap,
 #else
 		ret = dvb_attach(mxl5007t_attach, adap->fe, &adap->dev->i2c_adap,
 #endif
-			af9035_af9033_config[adap->id].tuner_address,
-			&af9035_mxl5007t_config[adap->id]) == NULL ? -ENODEV : 0;
+			addr, &af9035_mxl5007t_config[adap->id]) == NULL ?
+			-ENODEV : 0;
 
 		break;
-          case AF9033_TUNER_TDA18218:
-                  af9035_af9033_config[adap->id].tuner_address = af9035_tda18218_config[adap->id].i2c_address;
-                  af9035_af9033_config[adap->id].tuner_address += adap->id;
-                  if (adap->id == 0) {
-                  /* gpiot3 TUA9001 RESETN
-                  gpiot2 TUA9001 RXEN */
-                  ret = af9035_write_reg_bits(adap->dev, LINK,
-                          p_reg_top_gpiot2_en, reg_top_gpiot2_en_pos,
-                          reg_top_gpiot2_en_len, 1);
-                  ret = af9035_write_reg_bits(adap->dev, LINK,
-                          p_reg_top_gpiot2_on, reg_top_gpiot2_on_pos,
-                          reg_top_gpiot2_on_len, 1);
-                  ret = af9035_write_reg_bits(adap->dev, LINK,
-                          p_reg_top_gpiot3_en, reg_top_gpiot3_en_pos,
-                          reg_top_gpiot3_en_len, 1);
-                  ret = af9035_write_reg_bits(adap->dev, LINK,
-                          p_reg_top_gpiot3_on, reg_top_gpiot3_on_pos,
-                          reg_top_gpiot3_on_len, 1);
-
-                  /* reset tuner */
-                  ret = af9035_write_reg_bits(adap->dev, LINK, p_reg_top_gpiot3_o,
-                          reg_top_gpiot3_o_pos, reg_top_gpiot3_o_len, 0);
-                  msleep(1);
-                  ret = af9035_write_reg_bits(adap->dev, LINK, p_reg_top_gpiot3_o,
-                          reg_top_gpiot3_o_pos, reg_top_gpiot3_o_len, 1);
-
-                   /* activate tuner - TODO: do that like I2C gate control */
-                   ret = af9035_write_reg_bits(adap->dev, LINK, p_reg_top_gpiot2_o,
-                           reg_top_gpiot2_o_pos, reg_top_gpiot2_o_len, 1);
-                   }
-
+	case AF9033_TUNER_TDA18218:
 #ifdef V4L2_REFACTORED_MFE_CODE
-                   ret = dvb_attach(tda18218_attach, adap->fe_adap[0].fe, &adap->dev->i2c_adap,
+		ret = dvb_attach(tda18218_attach, adap->fe_adap[0].fe, &adap->dev->i2c_adap,
 #else
-                   ret = dvb_attach(tda18218_attach, adap->fe, &adap->dev->i2c_adap,
+		ret = dvb_attach(tda18218_attach, adap->fe, &adap->dev->i2c_adap,
 #endif
-                           &af9035_tda18218_config[adap->id]) == NULL ? -ENODEV : 0;
+			&af9035_tda18218_config[adap->id]) == NULL ? -ENODEV : 0;
 
-                   break;
+		break;
 	default:
 		ret = -ENODEV;
-		err("unknown tuner ID:%d",
-			af9035_af9033_config[adap->id].tuner);
+	}
+	if (!ret)
+		af9035_phase_end(state, AF9035_PHASE_TUNER_ATTACH + adap->id);
+
+	return ret;
+}
+
+/* dvb-usb calls this on first frontend open and last close, device is kept
+   resumed while any frontend is in use */
+static int af9035_power_ctrl(struct dvb_usb_device *d, int onoff)
+{
+	struct af9035_state *state = af9035_d_to_state(d);
+	int ret = 0;
+
+	/* dvb_usb_device_init powers device before it registers the I2C
+	   adapter, bind our state here so that the bridge has it */
+	if (!state) {
+		state = af9035_state_find(d->udev);
+		*(struct af9035_state **) d->priv = state;
+	}
+	if (!state)
+		return -ENODEV;
+
+	deb_info("%s: onoff:%d\n", __func__, onoff);
+
+	if (onoff && !state->pm_ref) {
+		ret = usb_autopm_get_interface(state->intf);
+		if (ret)
+			err("resume failed:%d", ret);
+		else
+			state->pm_ref = 1;
+	} else if (!onoff && state->pm_ref) {
+		state->pm_ref = 0;
+		usb_autopm_put_interface(state->intf);
 	}
 
 	return ret;
@@ -1052,11 +2961,12 @@ static struct dvb_usb_device_properties af9035_properties[] = {
 		.caps = DVB_USB_IS_AN_I2C_ADAPTER,
 
 		.usb_ctrl = DEVICE_SPECIFIC,
+		.power_ctrl = af9035_power_ctrl,
 		.download_firmware = af9035_download_firmware,
-		.firmware = "dvb-usb-af9035-01.fw",
+		.firmware = AF9035_FIRMWARE,
 		.no_reconnect = 1,
 
-		.size_of_priv = 0,
+		.size_of_priv = sizeof(struct af9035_state *),
 
 		.adapter = {
 			{
@@ -1137,13 +3047,96 @@ static struct dvb_usb_device_properties af9035_properties[] = {
 	},
 };
 
+/* everything after the state is created, may run in a work so that many
+   sticks come up at the same time */
+static int af9035_probe_device(struct af9035_state *state)
+{
+	struct dvb_usb_device *d = NULL;
+	int ret;
+	u8 i;
+
+	af9035_phase_start(state, AF9035_PHASE_READ_CONFIG);
+	ret = af9035_read_config(state);
+	if (!ret) {
+		af9035_phase_end(state, AF9035_PHASE_READ_CONFIG);
+		af9035_phase_start(state, AF9035_PHASE_AUX_INIT);
+		ret = af9035_aux_init(state);
+	}
+	/* identify_state finds the device warm after this */
+	if (!ret) {
+		af9035_phase_end(state, AF9035_PHASE_AUX_INIT);
+		af9035_phase_start(state, AF9035_PHASE_FW_LOAD);
+		ret = af9035_fw_load(state);
+	}
+	if (!ret)
+		af9035_phase_end(state, AF9035_PHASE_FW_LOAD);
+
+	/* adapters are registered in probe order, numbering stays the same
+	   however long the firmware download of each stick takes */
+	af9035_phase_start(state, AF9035_PHASE_REG_WAIT);
+	wait_event(af9035_probe_wq, af9035_probe_turn == state->probe_seq);
+	af9035_phase_end(state, AF9035_PHASE_REG_WAIT);
+
+	/* dvb-usb keeps pointers to props, use copy owned by device */
+	for (i = 0; !ret && i < af9035_properties_count; i++) {
+		state->props = af9035_properties[i];
+		af9035_set_properties(state, &state->props);
+		ret = dvb_usb_device_init(state->intf, &state->props,
+			THIS_MODULE, &d, adapter_nr);
+		if (ret != -ENODEV)
+			break;
+	}
+
+	mutex_lock(&af9035_dev_list_mutex);
+	af9035_probe_turn++;
+	mutex_unlock(&af9035_dev_list_mutex);
+	wake_up_all(&af9035_probe_wq);
+
+	if (ret)
+		return ret;
+
+	if (d) {
+		af9035_phase_start(state, AF9035_PHASE_INIT);
+		ret = af9035_init(d);
+		if (ret)
+			return ret;
+		af9035_phase_end(state, AF9035_PHASE_INIT);
+	}
+
+	af9035_phase_end(state, AF9035_PHASE_PROBE);
+	af9035_phase_log(state);
+
+	/* board tells whether it copes with selective suspend */
+	if (state->eeprom.selsuspend && af9035_autosuspend_ms > 0) {
+		pm_runtime_set_autosuspend_delay(&state->udev->dev,
+			af9035_autosuspend_ms);
+		usb_enable_autosuspend(state->udev);
+		deb_info("%s: autosuspend after %d ms\n", __func__,
+			af9035_autosuspend_ms);
+	}
+
+	return 0;
+}
+
+static void af9035_probe_work(struct work_struct *work)
+{
+	struct af9035_state *state = container_of(work, struct af9035_state,
+		probe_work);
+	int ret;
+
+	/* state stays until disconnect even when init fails */
+	ret = af9035_probe_device(state);
+	if (ret)
+		err("device init failed:%d", ret);
+	usb_autopm_put_interface(state->intf);
+	complete_all(&state->ready);
+}
+
 static int af9035_usb_probe(struct usb_interface *intf,
 			    const struct usb_device_id *id)
 {
 	int ret = 0;
-	struct dvb_usb_device *d = NULL;
-	struct usb_device *udev = interface_to_usbdev(intf);
-	u8 i;
+	struct af9035_state *state = NULL;
 
 	deb_info("%s: interface:%d\n", __func__,
 		intf->cur_altsetting->desc.bInterfaceNumber);
@@ -1151,47 +3144,209 @@ static int af9035_usb_probe(struct usb_interface *intf,
 	/* interface 0 is used by DVB-T receiver and
 	   interface 1 is for remote controller (HID) */
 	if (intf->cur_altsetting->desc.bInterfaceNumber == 0) {
-		ret = af9035_read_config(udev);
-		if (ret)
-			return ret;
+		state = af9035_state_create(intf);
+		if (!state)
+			return -ENOMEM;
+		af9035_phase_start(state, AF9035_PHASE_PROBE);
+
+		if (af9035_async_probe) {
+			/* usb core reference ends with probe, keep our own */
+			usb_autopm_get_interface_no_resume(intf);
+			INIT_WORK(&state->probe_work, af9035_probe_work);
+			queue_work(system_unbound_wq, &state->probe_work);
+			return 0;
+		}
 
-		ret = af9035_aux_init(udev);
+		ret = af9035_probe_device(state);
+		complete_all(&state->ready);
 		if (ret)
-			return ret;
+			goto error;
+	}
 
-		for (i = 0; i < af9035_properties_count; i++) {
-			ret = dvb_usb_device_init(intf, &af9035_properties[i],
-				THIS_MODULE, &d, adapter_nr);
-			if (!ret)
-				break;
-			if (ret != -ENODEV)
-				return ret;
+	return ret;
+error:
+	/* init may fail after adapters were registered, they reach state */
+	dvb_usb_device_exit(intf);
+	af9035_state_release(state);
+	return ret;
+}
+
+static struct af9035_state *af9035_intf_to_state(struct usb_interface *intf)
+{
+	struct af9035_state *state;
+
+	mutex_lock(&af9035_dev_list_mutex);
+	list_for_each_entry(state, &af9035_dev_list, list) {
+		if (state->intf == intf)
+			goto found;
+	}
+	state = NULL;
+found:
+	mutex_unlock(&af9035_dev_list_mutex);
+
+	return state;
+}
+
+static void af9035_usb_disconnect(struct usb_interface *intf)
+{
+	struct af9035_state *state = af9035_intf_to_state(intf);
+
+	/* async probe must not touch the device after this */
+	if (state)
+		wait_for_completion(&state->ready);
+
+	dvb_usb_device_exit(intf);
+
+	if (state)
+		af9035_state_release(state);
+}
+
+static int af9035_suspend(struct usb_interface *intf, pm_message_t message)
+{
+	struct af9035_state *state = af9035_intf_to_state(intf);
+	struct dvb_usb_device *d;
+	struct dvb_frontend *fe;
+	unsigned long used;
+	int i;
+
+	if (!state)
+		return 0;
+
+	/* demod power down work would talk to the suspended device */
+	d = state->d;
+	for (i = 0; d && i < d->num_adapters_initialized; i++) {
+#ifdef V4L2_REFACTORED_MFE_CODE
+		fe = d->adapter[i].fe_adap[0].fe;
+#else
+		fe = d->adapter[i].fe;
+#endif
+		if (fe)
+			af9033_sleep_sync(fe);
+	}
+
+	spin_lock_irq(&state->cmd_lock);
+	used = state->cmd_used;
+	spin_unlock_irq(&state->cmd_lock);
+
+	/* I2C transfers of other drivers still in flight */
+	if (PMSG_IS_AUTO(message) && used)
+		return -EBUSY;
+
+	deb_info("%s: auto:%d\n", __func__, PMSG_IS_AUTO(message) ? 1 : 0);
+
+	/* pending commands, if any, fail and are recovered on next use */
+	usb_kill_urb(state->rx_urb);
+
+	return 0;
+}
+
+/* bring device back to state it was probed to, firmware and registers are
+   lost when the stick was powered down while suspended */
+static int af9035_restore(struct af9035_state *state)
+{
+	struct dvb_usb_device *d = state->d;
+	struct dvb_frontend *fe;
+	int ret, i;
+	u8 wbuf[1] = {1};
+	u8 rbuf[4], tmp;
+	struct af9035_req req = {CMD_QUERYINFO, LINK, sizeof(wbuf), wbuf,
+		sizeof(rbuf), rbuf};
+
+	ret = af9035_ctrl_msg(state, &req);
+	if (ret)
+		goto error;
+
+	if (rbuf[0] || rbuf[1] || rbuf[2] || rbuf[3]) {
+		/* firmware runs, registers set by init may still be lost */
+		af9035_shadow_invalidate(state);
+		ret = af9035_read_reg_bis(state, LINK, AF9035_SCRATCH_REG, &tmp);
+		if (ret)
+			goto error;
+		if (tmp == AF9035_SCRATCH_INIT) {
+			deb_info("%s: registers kept\n", __func__);
+			return 0;
+		}
+	} else {
+		/* from image taken at probe, no file access here */
+		if (!state->fw) {
+			err("firmware lost while suspended, no image, resetting");
+			usb_queue_reset_device(state->intf);
+			ret = -ENOENT;
+			goto error;
 		}
+		info("firmware lost while suspended, reloading");
+		ret = af9035_fw_load(state);
 		if (ret)
-			return ret;
+			goto error;
+	}
+
+	ret = af9035_aux_init(state);
+	if (ret)
+		goto error;
+
+	ret = af9035_init(d);
+	if (ret)
+		goto error;
+
+	for (i = 0; i < d->num_adapters_initialized; i++) {
+#ifdef V4L2_REFACTORED_MFE_CODE
+		fe = d->adapter[i].fe_adap[0].fe;
+#else
+		fe = d->adapter[i].fe;
+#endif
+		if (!fe)
+			continue;
+		af9035_tuner_power_on(&d->adapter[i]);
 
-		if (d)
-			ret = af9035_init(d);
+		/* demod and tuner drivers see their registers are gone */
+		if (d->powered)
+			dvb_frontend_reinitialise(fe);
 	}
 
+	return 0;
+error:
+	err("resume failed:%d", ret);
 	return ret;
 }
 
+static int af9035_resume(struct usb_interface *intf)
+{
+	struct af9035_state *state = af9035_intf_to_state(intf);
+
+	/* nothing to restore before probe finished */
+	if (!state || !completion_done(&state->ready) || !state->d)
+		return 0;
+
+	return af9035_restore(state);
+}
+
 /* usb specific object needed to register this driver with the usb subsystem */
 static struct usb_driver af9035_usb_driver = {
 	.name = "dvb_usb_af9035",
 	.probe = af9035_usb_probe,
-	.disconnect = dvb_usb_device_exit,
+	.disconnect = af9035_usb_disconnect,
+	.suspend = af9035_suspend,
+	.resume = af9035_resume,
+	.reset_resume = af9035_resume,
 	.id_table = af9035_usb_table,
+	.supports_autosuspend = 1,
 };
 
 /* module stuff */
 static int __init af9035_usb_module_init(void)
 {
 	int ret;
+
+#ifdef CONFIG_DEBUG_FS
+	af9035_debugfs_root = debugfs_create_dir("af9035", NULL);
+#endif
 	ret = usb_register(&af9035_usb_driver);
-	if (ret)
+	if (ret) {
 		err("module init failed:%d", ret);
+#ifdef CONFIG_DEBUG_FS
+		debugfs_remove_recursive(af9035_debugfs_root);
+#endif
+	}
 
 	return ret;
 }
@@ -1200,6 +3355,9 @@ static void __exit af9035_usb_module_exit(void)
 {
 	/* deregister this driver from the USB subsystem */
 	usb_deregister(&af9035_usb_driver);
+#ifdef CONFIG_DEBUG_FS
+	debugfs_remove_recursive(af9035_debugfs_root);
+#endif
 }
 
 module_init(af9035_usb_module_init);
@@ -28,15 +28,42 @@
 
 #define DVB_USB_LOG_PREFIX "af9035"
 #include "dvb-usb.h"
+#include "af9033.h"
 
-#define deb_info(args...) dprintk(dvb_usb_af9035_debug, 0x01, args)
-#define deb_rc(args...)   dprintk(dvb_usb_af9035_debug, 0x02, args)
-#define deb_xfer(args...) dprintk(dvb_usb_af9035_debug, 0x04, args)
-#define deb_reg(args...)  dprintk(dvb_usb_af9035_debug, 0x08, args)
-#define deb_i2c(args...)  dprintk(dvb_usb_af9035_debug, 0x10, args)
-#define deb_fw(args...)   dprintk(dvb_usb_af9035_debug, 0x20, args)
+#include "debug_key.h"
+
+#ifdef CONFIG_DVB_USB_DEBUG
+#define af9035_dprintk(level, args...) \
+	do { \
+		if (debug_level(dvb_usb_af9035_debug, level)) \
+			printk(args); \
+	} while (0)
+#define deb_xfer_dump(prefix, buf, len) \
+	do { \
+		if (debug_level(dvb_usb_af9035_debug, 0x04)) \
+			print_hex_dump(KERN_DEBUG, prefix, DUMP_PREFIX_NONE, \
+				32, 1, buf, len, false); \
+	} while (0)
+#else
+#define af9035_dprintk(level, args...) do { } while (0)
+#define deb_xfer_dump(prefix, buf, len) do { } while (0)
+#endif
+
+#define deb_info(args...) af9035_dprintk(0x01, args)
+#define deb_rc(args...)   af9035_dprintk(0x02, args)
+#define deb_xfer(args...) af9035_dprintk(0x04, args)
+#define deb_reg(args...)  af9035_dprintk(0x08, args)
+#define deb_i2c(args...)  af9035_dprintk(0x10, args)
+#define deb_fw(args...)   af9035_dprintk(0x20, args)
 
 #define AF9035_USB_TIMEOUT 2000
+#define AF9035_TIMEOUT_MIN 100 /* adaptive register command timeout floor */
+#define AF9035_RTT_SAMPLES_MIN 8 /* static timeout is used before that */
+
+/* tuner readiness polling after GPIO reset */
+#define AF9035_TUNER_POLL_US 2000
+#define AF9035_MXL5007T_RESET_MS 300 /* fixed wait used before polling */
+#define AF9035_TDA18218_RESET_MS 20
 
 #define LINK 0x00
 #define OFDM 0x80
@@ -85,6 +112,29 @@
 #define EEPROM_IF1L2      (EEPROM_BASE_ADDR+EEPROM_SHIFT+0x30+2)
 #define EEPROM_IF1H2      (EEPROM_BASE_ADDR+EEPROM_SHIFT+0x30+3)
 
+/* config area read at once, IR mode .. 2nd tuner ID */
+#define EEPROM_CONFIG_ADDR EEPROM_IR_MODE
+#define EEPROM_CONFIG_LEN  (EEPROM_TUNER_ID2 - EEPROM_CONFIG_ADDR + 1)
+#define EEPROM_OFS(reg)    ((reg) - EEPROM_CONFIG_ADDR)
+
+/* decoded EEPROM config */
+struct af9035_eeprom {
+	u8 ir_mode;
+	u8 selsuspend;
+	u8 ts_mode;
+	u8 twowire_addr;
+	u8 suspend;
+	u8 ir_type;
+	struct {
+		u8 saw_bw;
+		u8 xtal;
+		u8 spec_inv;
+		u16 if_freq;
+		u16 mt2060_if1;
+		u8 tuner_id;
+	} adap[2];
+};
+
 struct af9035_clock {
 	u32 crystal;
 	u32 adc;
@@ -159,7 +209,8 @@ struct af9035_req {
 #define CMD_FIG_ADD                 0x88
 #define CMD_FIG_REMOVE              0x89
 
-/* this Linux driver does not implement usage of "short command" at all */
+/* "short command" ids as listed by vendor, payload len, reg_hi, reg_lo, only
+   demod reads are used, they share ids with tuner commands */
 #define CMD_SHORT_REG_DEMOD_READ    0x02
 #define CMD_SHORT_REG_DEMOD_WRITE   0X03
 #define CMD_SHORT_REG_TUNER_READ    0x04
@@ -176,6 +227,7 @@ struct af9035_segment {
 #define SEGMENT_DIRECT_CMD  2
 	u8 type;
 	u32 len;
+	u32 ofs; /* segment data offset in the firmware file */
 };
 
 struct af9035_firmware_header {
@@ -184,4 +236,191 @@ struct af9035_firmware_header {
 	struct af9035_segment segment[SEGMENT_MAX_COUNT];
 };
 
+#define AF9035_FIRMWARE "dvb-usb-af9035-01.fw"
+
+/* parsed firmware file, one for all devices */
+struct af9035_fw {
+	struct kref kref;
+	const struct firmware *fw;
+	struct af9035_firmware_header hdr;
+	u32 crc; /* of the whole file, checked before the image is reused */
+	u8 ver[8]; /* LINK and OFDM version seen after first boot */
+	u8 ver_valid:1;
+};
+
+/* one register of a scatter read / write list */
+struct af9035_reg_val {
+	u8  mbox;
+	u16 reg;
+	u8  val;
+};
+
+#define AF9035_BUF_SIZE 63
+
+/* registers per scatter command, payload is count + reg/val tuples */
+#define AF9035_SCATTER_WR_MAX ((AF9035_BUF_SIZE - 6 - 1) / 3)
+#define AF9035_SCATTER_RD_MAX ((AF9035_BUF_SIZE - 6 - 1) / 2)
+
+/* max data bytes of one demod register write, 63-6-6 */
+#define AF9035_DEMOD_WR_MAX (AF9035_BUF_SIZE - 6 - 6)
+
+/* I2C message bytes per tuner bridge command, register address included */
+#define AF9035_TUNER_WR_MAX (AF9035_BUF_SIZE - 6 - 4)
+#define AF9035_TUNER_RD_MAX (AF9035_BUF_SIZE - 5)
+
+/* same for generic I2C commands, 3 byte preamble and no register field */
+#define AF9035_GENERIC_WR_MAX (AF9035_BUF_SIZE - 6 - 3)
+#define AF9035_GENERIC_RD_MAX (AF9035_BUF_SIZE - 5)
+#define AF9035_GENERIC_I2C_BUS 0x03 /* tuner bus */
+
+/* written registers kept for bit writes */
+#define AF9035_SHADOW_SIZE 64
+
+/* max commands outstanding on EP2/EP81 per device */
+#define AF9035_CMD_INFLIGHT_MAX 16
+
+struct af9035_state;
+
+/* one command of the per device pool, replies are matched by seq */
+struct af9035_cmd {
+	struct list_head list;
+	struct af9035_state *state;
+	struct af9035_req req;
+	struct urb *urb; /* preallocated, reused for every command */
+	u8 *buf; /* kmalloc'd, DMA-safe */
+	u8 seq;
+#define AF9035_CMD_TX_DONE 0x01
+#define AF9035_CMD_RX_DONE 0x02
+	u8 flags;
+	int status; /* -EIO only when firmware refused it, -EPROTO or URB
+		       status when transfer failed */
+	struct completion done;
+	ktime_t t_queue; /* pool entry was asked for */
+	ktime_t t_submit;
+	ktime_t t_done;
+};
+
+/* control latency statistics per command id, last entry is for ids above */
+#define AF9035_STAT_CMDS 0x30
+#define AF9035_STAT_BUCKETS 12 /* <64us, <128us, ... >=65ms */
+
+struct af9035_cmd_stat {
+	u32 count;
+	u32 errors;
+	u64 total_us;
+	u32 max_us;
+	u32 hist[AF9035_STAT_BUCKETS];
+};
+
+/* commands queued back to back by one caller */
+struct af9035_batch {
+	struct af9035_state *state;
+	struct af9035_cmd *cmd[AF9035_CMD_INFLIGHT_MAX];
+	int num;
+	unsigned int max; /* in-flight limit, 0 for cmd_inflight param */
+};
+
+/* demod writes queued by the I2C bridge, shadowed once they are acked */
+#define AF9035_I2C_WR_MAX 16
+
+struct af9035_i2c_batch {
+	struct af9035_batch b;
+	struct {
+		u8 mbox;
+		u16 reg;
+		const u8 *val; /* in I2C message, valid during transfer */
+		u8 len;
+	} wr[AF9035_I2C_WR_MAX];
+	int wr_num;
+};
+
+/* demods chained on one bridge, chip number is in mailbox bits 4-6 */
+#define AF9035_I2C_BUS_MAX 8
+
+#define AF9035_I2C_NONE  0
+#define AF9035_I2C_DEMOD 1
+#define AF9035_I2C_TUNER 2
+
+/* where an I2C address used by demod and tuner drivers goes */
+struct af9035_i2c_route {
+	u8 type;
+	u8 mbox; /* added to mailbox, chip number of the demod */
+	u8 addr; /* tuner address on the bus behind its demod */
+	u8 bus; /* demod the device sits behind */
+	u8 generic; /* generic I2C commands read back same as tuner ones */
+};
+
+/* boot timeline phases, attach phases are per adapter */
+enum af9035_phase {
+	AF9035_PHASE_PROBE,
+	AF9035_PHASE_READ_CONFIG,
+	AF9035_PHASE_AUX_INIT,
+	AF9035_PHASE_FW_LOAD,
+	AF9035_PHASE_REG_WAIT, /* waiting earlier devices to register */
+	AF9035_PHASE_IDENTIFY,
+	AF9035_PHASE_FE_ATTACH,
+	AF9035_PHASE_TUNER_ATTACH = AF9035_PHASE_FE_ATTACH + 2,
+	AF9035_PHASE_INIT = AF9035_PHASE_TUNER_ATTACH + 2,
+	AF9035_PHASE_INIT_ENDPOINT,
+	AF9035_PHASE_NUM
+};
+
+struct af9035_phase_time {
+	ktime_t start;
+	ktime_t end; /* zero while running or when phase failed */
+};
+
+/* per device state, d->priv holds pointer to this */
+struct af9035_state {
+	struct list_head list;
+	struct usb_device *udev;
+	struct usb_interface *intf;
+
+	struct af9035_config config;
+	struct af9035_eeprom eeprom;
+	struct af9033_config af9033_config[2];
+	struct dvb_usb_device_properties props;
+	struct af9035_fw *fw; /* reference taken when firmware was downloaded */
+	struct dvb_usb_device *d; /* bound at frontend attach */
+	bool pm_ref; /* runtime PM reference held for open frontends */
+
+	struct work_struct probe_work;
+	unsigned int probe_seq; /* adapters are registered in this order */
+	struct completion ready; /* adapters registered or init failed */
+
+	struct af9035_phase_time phase[AF9035_PHASE_NUM];
+
+	spinlock_t cmd_lock;
+	struct list_head cmd_pending; /* commands waiting for reply */
+	wait_queue_head_t cmd_wait; /* command returned to the pool */
+	struct af9035_cmd cmd_pool[AF9035_CMD_INFLIGHT_MAX];
+	unsigned long cmd_used; /* bitmap of taken pool entries */
+	unsigned int cmd_inflight;
+	u8 seq; /* packet sequence number */
+
+	/* observed command latency, under cmd_lock */
+	u32 srtt_us;
+	u32 rttvar_us;
+	u8 rtt_samples;
+	struct mutex recover_lock;
+
+	struct mutex i2c_lock[AF9035_I2C_BUS_MAX]; /* I2C bridge, per bus */
+	struct af9035_i2c_route i2c_route[256]; /* by I2C address */
+
+	struct urb *rx_urb;
+	u8 *rx_buf;
+	u8 rx_active:1; /* under cmd_lock */
+	/* not bit fields, written without cmd_lock while rx_active changes */
+	bool scatter; /* firmware handles scatter read / write */
+	bool short_cmd; /* firmware handles short register commands */
+
+	struct af9035_cmd_stat stat[AF9035_STAT_CMDS]; /* under cmd_lock */
+	struct dentry *debugfs;
+
+	spinlock_t shadow_lock;
+	struct af9035_reg_val shadow[AF9035_SHADOW_SIZE];
+	u8 shadow_cnt;
+	u8 shadow_next;
+};
+
 #endif
@@ -0,0 +1,73 @@
+/*
+ * Afatech AF9035 DVB USB driver - control path tracepoints
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM af9035
+
+#if !defined(AF9035_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define AF9035_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/* one control command, times are in microseconds */
+TRACE_EVENT(af9035_cmd,
+
+	TP_PROTO(int devnum, u8 cmd, u8 mbox, u8 seq, u8 wlen, u8 rlen,
+		u32 queue_us, u32 wire_us, int status),
+
+	TP_ARGS(devnum, cmd, mbox, seq, wlen, rlen, queue_us, wire_us, status),
+
+	TP_STRUCT__entry(
+		__field(int, devnum)
+		__field(u8, cmd)
+		__field(u8, mbox)
+		__field(u8, seq)
+		__field(u8, wlen)
+		__field(u8, rlen)
+		__field(u32, queue_us)
+		__field(u32, wire_us)
+		__field(int, status)
+	),
+
+	TP_fast_assign(
+		__entry->devnum = devnum;
+		__entry->cmd = cmd;
+		__entry->mbox = mbox;
+		__entry->seq = seq;
+		__entry->wlen = wlen;
+		__entry->rlen = rlen;
+		__entry->queue_us = queue_us;
+		__entry->wire_us = wire_us;
+		__entry->status = status;
+	),
+
+	TP_printk("dev:%d cmd:%02x mbox:%02x seq:%02x wlen:%u rlen:%u "
+		"queue:%uus wire:%uus status:%d",
+		__entry->devnum, __entry->cmd, __entry->mbox, __entry->seq,
+		__entry->wlen, __entry->rlen, __entry->queue_us,
+		__entry->wire_us, __entry->status)
+);
+
+#endif /* AF9035_TRACE_H */
+
+/* driver is built out of kernel tree, header is next to the source */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE af9035_trace
+#include <trace/define_trace.h>
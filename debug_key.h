@@ -0,0 +1,68 @@
+/*
+ * Debug level module parameter backed by a static key
+ *
+ *    This program is free software; you can redistribute it and/or modify
+ *    it under the terms of the GNU General Public License as published by
+ *    the Free Software Foundation; either version 2 of the License, or
+ *    (at your option) any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ */
+
+#ifndef DEBUG_KEY_H
+#define DEBUG_KEY_H
+
+#include <linux/version.h>
+#include <linux/moduleparam.h>
+#include <linux/jump_label.h>
+
+/* While debug level is 0 the key is off and log statements are a patched
+   out branch, the level itself is looked only when the key is on. */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3, 3, 0)
+#define debug_key_t struct static_key
+#define DEBUG_KEY_INIT STATIC_KEY_INIT_FALSE
+#define debug_key_on(key) static_key_false(key)
+#define debug_key_inc(key) static_key_slow_inc(key)
+#define debug_key_dec(key) static_key_slow_dec(key)
+#else
+#define debug_key_t struct jump_label_key
+#define DEBUG_KEY_INIT { }
+#define debug_key_on(key) static_branch(key)
+#define debug_key_inc(key) jump_label_inc(key)
+#define debug_key_dec(key) jump_label_dec(key)
+#endif
+
+/* define int debug level variable and module parameter for it */
+#define DEFINE_DEBUG_PARAM(name, var) \
+static int var; \
+static debug_key_t var##_key = DEBUG_KEY_INIT; \
+static int var##_set(const char *val, const struct kernel_param *kp) \
+{ \
+	int old = var, ret; \
+	ret = param_set_int(val, kp); \
+	if (ret) \
+		return ret; \
+	if (!old && var) \
+		debug_key_inc(&var##_key); \
+	else if (old && !var) \
+		debug_key_dec(&var##_key); \
+	return 0; \
+} \
+static struct kernel_param_ops var##_ops = { \
+	.set = var##_set, \
+	.get = param_get_int, \
+}; \
+module_param_cb(name, &var##_ops, &var, 0644)
+
+/* true when given debug level bit of the parameter is set */
+#define debug_level(var, level) \
+	(debug_key_on(&var##_key) && ((var) & (level)))
+
+#endif /* DEBUG_KEY_H */
@@ -23,14 +23,19 @@
 #include <linux/videodev2.h>
 #include "tuner-i2c.h"
 #include "mxl5007t.h"
+#include "debug_key.h"
 
 static DEFINE_MUTEX(mxl5007t_list_mutex);
 static LIST_HEAD(hybrid_tuner_instance_list);
 
-static int mxl5007t_debug;
-module_param_named(debug, mxl5007t_debug, int, 0644);
+DEFINE_DEBUG_PARAM(debug, mxl5007t_debug);
 MODULE_PARM_DESC(debug, "set debug level");
 
+/* older kernels have no own bit for it */
+#ifndef I2C_FUNC_NOSTART
+#define I2C_FUNC_NOSTART I2C_FUNC_PROTOCOL_MANGLING
+#endif
+
 /* ------------------------------------------------------------------------- */
 
 #define mxl_printk(kern, fmt, arg...) \
@@ -47,7 +52,7 @@ MODULE_PARM_DESC(debug, "set debug level");
 
 #define mxl_debug(fmt, arg...)				\
 ({							\
-	if (mxl5007t_debug)				\
+	if (debug_level(mxl5007t_debug, ~0))		\
 		mxl_printk(KERN_DEBUG, fmt, ##arg);	\
 })
 
@@ -476,18 +481,39 @@ static int mxl5007t_write_reg(struct mxl5007t_state *state, u8 reg, u8 val)
 	return 0;
 }
 
+/* whole list in one transfer, pairs after the first continue the same
+   write like the reference code does when the adapter can do that */
 static int mxl5007t_write_regs(struct mxl5007t_state *state,
 			       struct reg_pair_t *reg_pair)
 {
+	struct i2c_msg msg[ARRAY_SIZE(init_tab_cable)];
 	unsigned int i = 0;
-	int ret = 0;
+	u16 flags = 0;
+	int ret;
+
+	if (i2c_check_functionality(state->i2c_props.adap, I2C_FUNC_NOSTART))
+		flags = I2C_M_NOSTART;
 
-	while ((ret == 0) && (reg_pair[i].reg || reg_pair[i].val)) {
-		ret = mxl5007t_write_reg(state,
-					 reg_pair[i].reg, reg_pair[i].val);
+	while (reg_pair[i].reg || reg_pair[i].val) {
+		if (i >= ARRAY_SIZE(msg)) {
+			mxl_err("too many registers");
+			return -EINVAL;
+		}
+		msg[i].addr = state->i2c_props.addr;
+		msg[i].flags = i ? flags : 0;
+		msg[i].buf = &reg_pair[i].reg;
+		msg[i].len = 2;
 		i++;
 	}
-	return ret;
+	if (!i)
+		return 0;
+
+	ret = i2c_transfer(state->i2c_props.adap, msg, i);
+	if (ret != i) {
+		mxl_err("failed!");
+		return -EREMOTEIO;
+	}
+	return 0;
 }
 
 static int mxl5007t_read_reg(struct mxl5007t_state *state, u8 reg, u8 *val)
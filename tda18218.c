@@ -21,15 +21,14 @@
 #include "tda18218.h"
 #include "tda18218_priv.h"
 
-static int debug;
-module_param(debug, int, 0644);
+DEFINE_DEBUG_PARAM(debug, debug);
 MODULE_PARM_DESC(debug, "Turn on/off debugging (default:off).");
 
 /* write multiple registers */
 static int tda18218_wr_regs(struct tda18218_priv *priv, u8 reg, u8 *val, u8 len)
 {
 	int ret = 0;
-	u8 buf[1+len], quotient, remainder, i, msg_len, msg_len_max;
+	u8 buf[1+len], i, msg_len, msg_len_max;
 	struct i2c_msg msg[1] = {
 		{
 			.addr = priv->cfg->i2c_address,
@@ -38,17 +37,14 @@ static int tda18218_wr_regs(struct tda18218_priv *priv, u8 reg, u8 *val, u8 len)
 		}
 	};
 
+	/* len being multiple of msg_len_max must be written too */
 	msg_len_max = priv->cfg->i2c_wr_max - 1;
-	quotient = len / msg_len_max;
-	remainder = len % msg_len_max;
-	msg_len = msg_len_max;
-	for (i = 0; (i <= quotient && remainder); i++) {
-		if (i == quotient)  /* set len of the last msg */
-			msg_len = remainder;
+	for (i = 0; i < len; i += msg_len) {
+		msg_len = min_t(u8, len - i, msg_len_max);
 
 		msg[0].len = msg_len + 1;
-		buf[0] = reg + i * msg_len_max;
-		memcpy(&buf[1], &val[i * msg_len_max], msg_len);
+		buf[0] = reg + i;
+		memcpy(&buf[1], &val[i], msg_len);
 
 		ret = i2c_transfer(priv->i2c, msg, 1);
 		if (ret != 1)
@@ -223,6 +219,7 @@ static int tda18218_sleep(struct dvb_frontend *fe)
 
 	/* standby */
 	ret = tda18218_wr_reg(priv, R17_PD1, priv->regs[R17_PD1] | (1 << 0));
+	priv->standby = !ret;
 
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 0); /* close I2C-gate */
@@ -237,14 +234,29 @@ static int tda18218_init(struct dvb_frontend *fe)
 {
 	struct tda18218_priv *priv = fe->tuner_priv;
 	int ret;
+	u8 val;
 
 	/* TODO: calibrations */
 
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 1); /* open I2C-gate */
 
-	ret = tda18218_wr_regs(priv, R00_ID, priv->regs, TDA18218_NUM_REGS);
+	/* standby bit set by sleep reads back when chip kept its registers,
+	   leave standby only instead of writing whole register image */
+	if (priv->standby) {
+		priv->standby = 0;
+		ret = tda18218_rd_reg(priv, R17_PD1, &val);
+		if (!ret && val == (priv->regs[R17_PD1] | (1 << 0))) {
+			dbg("%s: registers kept", __func__);
+			ret = tda18218_wr_reg(priv, R17_PD1,
+				priv->regs[R17_PD1]);
+			if (!ret)
+				goto exit;
+		}
+	}
 
+	ret = tda18218_wr_regs(priv, R00_ID, priv->regs, TDA18218_NUM_REGS);
+exit:
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 0); /* close I2C-gate */
 
@@ -328,6 +340,7 @@ struct dvb_frontend *tda18218_attach(struct dvb_frontend *fe,
 
 	/* standby */
 	ret = tda18218_wr_reg(priv, R17_PD1, priv->regs[R17_PD1] | (1 << 0));
+	priv->standby = !ret;
 	if (ret)
 		dbg("%s: failed ret:%d", __func__, ret);
 
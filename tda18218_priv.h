@@ -23,10 +23,14 @@
 
 #define LOG_PREFIX "tda18218"
 
+#include "debug_key.h"
+
 #undef dbg
 #define dbg(f, arg...) \
-	if (debug) \
-		printk(KERN_DEBUG   LOG_PREFIX": " f "\n" , ## arg)
+	do { \
+		if (debug_level(debug, ~0)) \
+			printk(KERN_DEBUG   LOG_PREFIX": " f "\n" , ## arg); \
+	} while (0)
 #undef err
 #define err(f, arg...)  printk(KERN_ERR     LOG_PREFIX": " f "\n" , ## arg)
 #undef info
@@ -103,6 +107,7 @@ struct tda18218_priv {
 	u32 if_frequency;
 
 	u8 regs[TDA18218_NUM_REGS];
+	u8 standby:1; /* put to standby by sleep */
 };
 
 #endif
@@ -33,19 +33,32 @@
 #define V4L2_ONLY_DVB_V5
 #endif
 
-static int debug;
-module_param(debug, int, 0644);
+DEFINE_DEBUG_PARAM(debug, debug);
 MODULE_PARM_DESC(debug, "debug");
 
-/* write register */
-static int tua9001_writereg(struct tua9001_priv *priv, u8 reg, u16 val)
+/* write register list as one transfer, adapter may queue messages */
+static int tua9001_writeregs(struct tua9001_priv *priv,
+	const struct regdesc *data, u8 num)
 {
-	u8 buf[3] = {reg, val >> 8, val & 0xff};
-	struct i2c_msg msg = { .addr = priv->cfg->i2c_address,
-		.flags = 0, .buf = buf, .len = 3 };
+	u8 buf[TUA9001_REGS_MAX][3];
+	struct i2c_msg msg[TUA9001_REGS_MAX];
+	u8 i;
+
+	if (num > TUA9001_REGS_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		buf[i][0] = data[i].reg;
+		buf[i][1] = data[i].val >> 8;
+		buf[i][2] = data[i].val & 0xff;
+		msg[i].addr = priv->cfg->i2c_address;
+		msg[i].flags = 0;
+		msg[i].buf = buf[i];
+		msg[i].len = 3;
+	}
 
-	if (i2c_transfer(priv->i2c, &msg, 1) != 1) {
-		err("I2C write failed, reg:%02x", reg);
+	if (i2c_transfer(priv->i2c, msg, num) != num) {
+		err("I2C write failed, reg:%02x num:%d", data[0].reg, num);
 		return -EREMOTEIO;
 	}
 	return 0;
@@ -62,7 +75,6 @@ static int tua9001_init(struct dvb_frontend *fe)
 {
 	struct tua9001_priv *priv = fe->tuner_priv;
 	int ret = 0;
-	u8 i;
 	struct regdesc data[] = {
 		{0x1e, 0x6512},
 		{0x25, 0xb888},
@@ -84,11 +96,7 @@ static int tua9001_init(struct dvb_frontend *fe)
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 1); /* open i2c-gate */
 
-	for (i = 0; i < ARRAY_SIZE(data); i++) {
-		ret = tua9001_writereg(priv, data[i].reg, data[i].val);
-		if (ret)
-			break;
-	}
+	ret = tua9001_writeregs(priv, data, ARRAY_SIZE(data));
 
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 0); /* close i2c-gate */
@@ -107,7 +115,6 @@ static int tua9001_set_params(struct dvb_frontend *fe)
 	int ret;
 	u16 val;
 	u32 freq;
-	u8 i;
 	struct regdesc data[2];
 
 	switch (params->bandwidth_hz) {
@@ -152,11 +159,7 @@ val = freq;
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 1); /* open i2c-gate */
 
-	for (i = 0; i < ARRAY_SIZE(data); i++) {
-		ret = tua9001_writereg(priv, data[i].reg, data[i].val);
-		if (ret)
-			break;
-	}
+	ret = tua9001_writeregs(priv, data, ARRAY_SIZE(data));
 
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 0); /* close i2c-gate */
@@ -174,7 +177,6 @@ static int tua9001_set_params(struct dvb_frontend *fe,
 	int ret;
 	u16 val;
 	u32 freq;
-	u8 i;
 	struct regdesc data[2];
 
 	switch (params->u.ofdm.bandwidth) {
@@ -219,11 +221,7 @@ val = freq;
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 1); /* open i2c-gate */
 
-	for (i = 0; i < ARRAY_SIZE(data); i++) {
-		ret = tua9001_writereg(priv, data[i].reg, data[i].val);
-		if (ret)
-			break;
-	}
+	ret = tua9001_writeregs(priv, data, ARRAY_SIZE(data));
 
 	if (fe->ops.i2c_gate_ctrl)
 		fe->ops.i2c_gate_ctrl(fe, 0); /* close i2c-gate */
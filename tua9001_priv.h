@@ -23,9 +23,11 @@
 
 #define LOG_PREFIX "tua9001"
 
+#include "debug_key.h"
+
 #define dprintk(var, level, args...) \
 	do { \
-		if ((var & level)) \
+		if (debug_level(var, level)) \
 			printk(args); \
 	} while (0)
 
@@ -43,6 +45,9 @@ struct regdesc {
 	u16 val;
 };
 
+/* longest register list, the init one */
+#define TUA9001_REGS_MAX 15
+
 struct tua9001_priv {
 	struct tua9001_config *cfg;
 	struct i2c_adapter *i2c;